@@ -1,12 +1,24 @@
 #include "actor.h"
 
 struct render_spec rspecs[ACTOR_TYPE_END];
+uint32_t cmasks[ACTOR_TYPE_END];
+bool statics[ACTOR_TYPE_END];
 
 void actor_types_init()
 {
     rspecs[ACTOR_TYPE_PLAYER].mesh_handle = ASSET_MESH_PLAYER;
     rspecs[ACTOR_TYPE_ORB].mesh_handle = ASSET_MESH_ORB;
     rspecs[ACTOR_TYPE_WALL].mesh_handle = ASSET_MESH_WALL;
+
+    // Two types collide if either one lists the other
+    cmasks[ACTOR_TYPE_PLAYER] = actor_type_bit(ACTOR_TYPE_ORB);
+    cmasks[ACTOR_TYPE_ORB] = 0;
+    cmasks[ACTOR_TYPE_WALL] =
+        actor_type_bit(ACTOR_TYPE_PLAYER) | actor_type_bit(ACTOR_TYPE_ORB);
+
+    statics[ACTOR_TYPE_PLAYER] = false;
+    statics[ACTOR_TYPE_ORB] = false;
+    statics[ACTOR_TYPE_WALL] = true;
 }
 
 void cbox_init(struct cbox *c)
@@ -15,24 +27,13 @@ void cbox_init(struct cbox *c)
     c->offset = VEC3_ZERO;
 }
 
-void actor_init(struct actor *ac, struct world *world, uint16_t id,
-        enum actor_type type, uint8_t spawn_tick, struct vec3 pos)
+void actor_init(struct actor *ac, struct actor_id id, enum actor_type type)
 {
     ac->id = id;
-    ac->world = world;
     ac->type = type;
     ac->flags = 0;
-    ac->spawn_tick = spawn_tick;
-    transform_init(&ac->transform, pos);
-    cbox_init(&ac->cbox);
-    ac->data = NULL;
-    ac->collide_mask = 0;
-    ac->on_collide = NULL;
-}
-
-void actor_free(struct actor *ac)
-{
-    free(ac->data);
+    ac->shape = COLLIDER_OBB;
+    ac->proxy = ACTOR_NO_PROXY;
 }
 
 void actor_kill(struct actor *ac)
@@ -49,3 +50,13 @@ struct render_spec actor_type_render_spec(enum actor_type type)
 {
     return rspecs[type];
 }
+
+uint32_t actor_type_collide_mask(enum actor_type type)
+{
+    return cmasks[type];
+}
+
+bool actor_type_static(enum actor_type type)
+{
+    return statics[type];
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include "transform.h"
@@ -17,27 +18,41 @@ enum
     ACTOR_DEAD = 1 << 0,
 };
 
+#define ACTOR_NO_PROXY -1
+
+// Shapes fitted to the collision box, see struct obb for how. Half-spaces
+// have unbounded bounds and are only supported on static types.
+enum collider_shape
+{
+    COLLIDER_OBB,
+    COLLIDER_SPHERE,
+    COLLIDER_HALF_SPACE,
+    COLLIDER_SHAPE_END,
+};
+
 struct cbox
 {
     struct vec3 offset;
     struct vec3 bounds;
 };
 
-struct actor;
-typedef void(*actor_on_collide)(struct actor*, struct actor*);
+// Generational handle, stale once the actor has been removed
+struct actor_id
+{
+    uint32_t slot;
+    uint32_t gen;
+};
 
+// Components of an actor are stored in its world's actor group
 struct actor
 {
-    uint16_t id;
-    struct world *world;
-    struct transform transform;
-    struct cbox cbox;
+    struct actor_id id;
     int flags;
     enum actor_type type;
-    uint8_t spawn_tick;
-    void *data;
-    uint32_t collide_mask;
-    actor_on_collide on_collide;
+    enum collider_shape shape;
+    // Handle in the static tree for static types, otherwise in the active
+    // incremental broadphase
+    int32_t proxy;
 };
 
 struct render_spec
@@ -49,11 +64,12 @@ void actor_types_init();
 
 void cbox_init(struct cbox *c);
 
-void actor_init(struct actor *ac, struct world *world, uint16_t id, enum actor_type type,
-        uint8_t spawn_tick, struct vec3 pos);
-void actor_free(struct actor *ac);
+void actor_init(struct actor *ac, struct actor_id id, enum actor_type type);
 
 void actor_kill(struct actor *ac);
 
 int actor_type_bit(enum actor_type type);
 struct render_spec actor_type_render_spec(enum actor_type type);
+uint32_t actor_type_collide_mask(enum actor_type type);
+// Actors of static types never move after they are spawned
+bool actor_type_static(enum actor_type type);
@@ -0,0 +1,111 @@
+#include "arena.h"
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+static size_t align_up(size_t val)
+{
+    return (val + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static uint8_t *block_data(struct arena_block *b)
+{
+    return (uint8_t *)b + align_up(sizeof(struct arena_block));
+}
+
+static struct arena_block *new_block(size_t size)
+{
+    struct arena_block *b =
+        malloc(align_up(sizeof(struct arena_block)) + size);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+void arena_init(struct arena *a, size_t block_size)
+{
+    a->block_size = block_size;
+    a->first = new_block(block_size);
+    a->current = a->first;
+}
+
+void arena_free(struct arena *a)
+{
+    struct arena_block *b = a->first;
+    while (b)
+    {
+        struct arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+
+    a->first = NULL;
+    a->current = NULL;
+}
+
+void arena_reset(struct arena *a)
+{
+    for (struct arena_block *b = a->first; b; b = b->next)
+    {
+        b->used = 0;
+    }
+
+    a->current = a->first;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    size = align_up(size);
+
+    struct arena_block *b = a->current;
+    while (b->used + size > b->size)
+    {
+        if (!b->next || b->next->size < size)
+        {
+            // Blocks double in size so that large worlds need few of them
+            size_t block_size = a->block_size;
+            while (block_size < size)
+            {
+                block_size *= 2;
+            }
+            a->block_size *= 2;
+
+            struct arena_block *nb = new_block(block_size);
+            nb->next = b->next;
+            b->next = nb;
+        }
+
+        b = b->next;
+    }
+
+    a->current = b;
+
+    void *res = block_data(b) + b->used;
+    b->used += size;
+    return res;
+}
+
+void *arena_realloc(struct arena *a, void *ptr, size_t old_size,
+        size_t new_size)
+{
+    if (!ptr)
+    {
+        return arena_alloc(a, new_size);
+    }
+
+    struct arena_block *b = a->current;
+    uint8_t *end = block_data(b) + b->used;
+    size_t old_aligned = align_up(old_size);
+
+    if ((uint8_t *)ptr + old_aligned == end &&
+            b->used - old_aligned + align_up(new_size) <= b->size)
+    {
+        b->used = b->used - old_aligned + align_up(new_size);
+        return ptr;
+    }
+
+    void *res = arena_alloc(a, new_size);
+    memcpy(res, ptr, old_size < new_size ? old_size : new_size);
+    return res;
+}
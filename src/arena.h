@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+};
+
+// Bump allocator over a chain of blocks. Memory is only released all at
+// once, and reset keeps the blocks around for the next use.
+struct arena
+{
+    struct arena_block *first;
+    struct arena_block *current;
+    size_t block_size;
+};
+
+void arena_init(struct arena *a, size_t block_size);
+void arena_free(struct arena *a);
+void arena_reset(struct arena *a);
+
+void *arena_alloc(struct arena *a, size_t size);
+
+// Grows an allocation in place if it was the last one in its block,
+// otherwise copies it to a new allocation
+void *arena_realloc(struct arena *a, void *ptr, size_t old_size,
+        size_t new_size);
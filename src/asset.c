@@ -158,6 +158,7 @@ static bool load_mesh(enum asset_mesh handle, const char *name)
     }
 
     fclose(f);
+    mesh_update_radius(mesh);
 
     return true;
 }
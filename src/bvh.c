@@ -0,0 +1,525 @@
+#include "bvh.h"
+#include <assert.h>
+#include <math.h>
+
+#define BVH_START_CAPACITY      256
+#define BVH_FAT_MARGIN          0.2f
+#define BVH_DISPLACEMENT_MUL    4.0f
+
+static struct bbox bbox_union(struct bbox a, struct bbox b)
+{
+    struct bbox res;
+    res.x1 = fminf(a.x1, b.x1);
+    res.x2 = fmaxf(a.x2, b.x2);
+    res.y1 = fminf(a.y1, b.y1);
+    res.y2 = fmaxf(a.y2, b.y2);
+    res.z1 = fminf(a.z1, b.z1);
+    res.z2 = fmaxf(a.z2, b.z2);
+
+    return res;
+}
+
+static float bbox_area(struct bbox b)
+{
+    float dx = b.x2 - b.x1;
+    float dy = b.y2 - b.y1;
+    float dz = b.z2 - b.z1;
+
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static bool bbox_contains(struct bbox outer, struct bbox inner)
+{
+    return
+        outer.x1 <= inner.x1 &&
+        outer.x2 >= inner.x2 &&
+        outer.y1 <= inner.y1 &&
+        outer.y2 >= inner.y2 &&
+        outer.z1 <= inner.z1 &&
+        outer.z2 >= inner.z2;
+}
+
+static struct bbox bbox_enlarge(struct bbox b, float amount)
+{
+    b.x1 -= amount;
+    b.x2 += amount;
+    b.y1 -= amount;
+    b.y2 += amount;
+    b.z1 -= amount;
+    b.z2 += amount;
+
+    return b;
+}
+
+static struct vec3 bbox_center(struct bbox b)
+{
+    return vec3_create((b.x1 + b.x2) * 0.5f, (b.y1 + b.y2) * 0.5f,
+            (b.z1 + b.z2) * 0.5f);
+}
+
+// Extends the bounds in the direction of movement, so that the leaf
+// keeps containing the entry for a few more ticks
+static struct bbox bbox_fatten(struct bbox b, struct vec3 displacement)
+{
+    b = bbox_enlarge(b, BVH_FAT_MARGIN);
+
+    struct vec3 d = vec3_mul(displacement, BVH_DISPLACEMENT_MUL);
+    if (d.x < 0.0f) b.x1 += d.x; else b.x2 += d.x;
+    if (d.y < 0.0f) b.y1 += d.y; else b.y2 += d.y;
+    if (d.z < 0.0f) b.z1 += d.z; else b.z2 += d.z;
+
+    return b;
+}
+
+static bool is_leaf(const struct bvh_node *node)
+{
+    return node->left == BVH_NULL_NODE;
+}
+
+static int32_t alloc_node(struct bvh *t)
+{
+    if (t->free_list == BVH_NULL_NODE)
+    {
+        size_t old_capacity = t->capacity;
+        t->capacity *= 2;
+        t->nodes = realloc(t->nodes, t->capacity * sizeof(struct bvh_node));
+
+        for (size_t i = old_capacity; i < t->capacity; i++)
+        {
+            t->nodes[i].parent = i + 1 < t->capacity ?
+                (int32_t)(i + 1) : BVH_NULL_NODE;
+            t->nodes[i].height = -1;
+        }
+
+        t->free_list = (int32_t)old_capacity;
+    }
+
+    int32_t index = t->free_list;
+    struct bvh_node *node = t->nodes + index;
+    t->free_list = node->parent;
+
+    node->parent = BVH_NULL_NODE;
+    node->left = BVH_NULL_NODE;
+    node->right = BVH_NULL_NODE;
+    node->height = 0;
+    node->id = 0;
+    t->count++;
+
+    return index;
+}
+
+static void free_node(struct bvh *t, int32_t index)
+{
+    assert(t->count);
+
+    struct bvh_node *node = t->nodes + index;
+    node->parent = t->free_list;
+    node->height = -1;
+    t->free_list = index;
+    t->count--;
+}
+
+static void replace_child(struct bvh *t, int32_t parent, int32_t old_child,
+        int32_t new_child)
+{
+    if (parent == BVH_NULL_NODE)
+    {
+        t->root = new_child;
+        return;
+    }
+
+    struct bvh_node *p = t->nodes + parent;
+    if (p->left == old_child)
+    {
+        p->left = new_child;
+    }
+    else
+    {
+        assert(p->right == old_child);
+        p->right = new_child;
+    }
+}
+
+static void refit_node(struct bvh *t, int32_t index)
+{
+    struct bvh_node *node = t->nodes + index;
+    struct bvh_node *left = t->nodes + node->left;
+    struct bvh_node *right = t->nodes + node->right;
+
+    node->box = bbox_union(left->box, right->box);
+    node->height = 1 + (left->height > right->height ?
+            left->height : right->height);
+}
+
+// Rotates the taller child of a up if the subtree is imbalanced,
+// returns the new root of the subtree
+static int32_t balance(struct bvh *t, int32_t ia)
+{
+    struct bvh_node *a = t->nodes + ia;
+    if (is_leaf(a) || a->height < 2)
+    {
+        return ia;
+    }
+
+    int32_t ib = a->left;
+    int32_t ic = a->right;
+    struct bvh_node *b = t->nodes + ib;
+    struct bvh_node *c = t->nodes + ic;
+
+    int32_t diff = c->height - b->height;
+    if (diff > 1)
+    {
+        int32_t i_f = c->left;
+        int32_t ig = c->right;
+        struct bvh_node *f = t->nodes + i_f;
+        struct bvh_node *g = t->nodes + ig;
+
+        c->left = ia;
+        c->parent = a->parent;
+        a->parent = ic;
+        replace_child(t, c->parent, ia, ic);
+
+        if (f->height > g->height)
+        {
+            c->right = i_f;
+            a->right = ig;
+            g->parent = ia;
+        }
+        else
+        {
+            c->right = ig;
+            a->right = i_f;
+            f->parent = ia;
+        }
+
+        refit_node(t, ia);
+        refit_node(t, ic);
+        return ic;
+    }
+
+    if (diff < -1)
+    {
+        int32_t id = b->left;
+        int32_t ie = b->right;
+        struct bvh_node *d = t->nodes + id;
+        struct bvh_node *e = t->nodes + ie;
+
+        b->left = ia;
+        b->parent = a->parent;
+        a->parent = ib;
+        replace_child(t, b->parent, ia, ib);
+
+        if (d->height > e->height)
+        {
+            b->right = id;
+            a->left = ie;
+            e->parent = ia;
+        }
+        else
+        {
+            b->right = ie;
+            a->left = id;
+            d->parent = ia;
+        }
+
+        refit_node(t, ia);
+        refit_node(t, ib);
+        return ib;
+    }
+
+    return ia;
+}
+
+static void refit_ancestors(struct bvh *t, int32_t index)
+{
+    while (index != BVH_NULL_NODE)
+    {
+        index = balance(t, index);
+        refit_node(t, index);
+        index = t->nodes[index].parent;
+    }
+}
+
+static float descend_cost(const struct bvh *t, int32_t index,
+        struct bbox box, float inheritance_cost)
+{
+    const struct bvh_node *node = t->nodes + index;
+    float area = bbox_area(bbox_union(box, node->box));
+    if (!is_leaf(node))
+    {
+        area -= bbox_area(node->box);
+    }
+
+    return area + inheritance_cost;
+}
+
+static void insert_leaf(struct bvh *t, int32_t leaf)
+{
+    if (t->root == BVH_NULL_NODE)
+    {
+        t->root = leaf;
+        t->nodes[leaf].parent = BVH_NULL_NODE;
+        return;
+    }
+
+    // Find the cheapest sibling using the surface area heuristic
+    struct bbox box = t->nodes[leaf].box;
+    int32_t index = t->root;
+    while (!is_leaf(t->nodes + index))
+    {
+        const struct bvh_node *node = t->nodes + index;
+
+        float area = bbox_area(node->box);
+        float combined_area = bbox_area(bbox_union(node->box, box));
+
+        float cost = 2.0f * combined_area;
+        float inheritance_cost = 2.0f * (combined_area - area);
+
+        float cost_left = descend_cost(t, node->left, box, inheritance_cost);
+        float cost_right = descend_cost(t, node->right, box,
+                inheritance_cost);
+
+        if (cost < cost_left && cost < cost_right)
+        {
+            break;
+        }
+
+        index = cost_left < cost_right ? node->left : node->right;
+    }
+
+    int32_t sibling = index;
+    int32_t old_parent = t->nodes[sibling].parent;
+    int32_t new_parent = alloc_node(t);
+
+    struct bvh_node *p = t->nodes + new_parent;
+    p->parent = old_parent;
+    p->box = bbox_union(box, t->nodes[sibling].box);
+    p->height = t->nodes[sibling].height + 1;
+    p->left = sibling;
+    p->right = leaf;
+
+    replace_child(t, old_parent, sibling, new_parent);
+    t->nodes[sibling].parent = new_parent;
+    t->nodes[leaf].parent = new_parent;
+
+    refit_ancestors(t, new_parent);
+}
+
+static void remove_leaf(struct bvh *t, int32_t leaf)
+{
+    if (leaf == t->root)
+    {
+        t->root = BVH_NULL_NODE;
+        return;
+    }
+
+    int32_t parent = t->nodes[leaf].parent;
+    int32_t grand_parent = t->nodes[parent].parent;
+    int32_t sibling = t->nodes[parent].left == leaf ?
+        t->nodes[parent].right : t->nodes[parent].left;
+
+    replace_child(t, grand_parent, parent, sibling);
+    t->nodes[sibling].parent = grand_parent;
+    free_node(t, parent);
+
+    refit_ancestors(t, grand_parent);
+}
+
+static void push_stack(struct bvh *t, size_t *top, int32_t index)
+{
+    if (*top == t->stack_capacity)
+    {
+        t->stack_capacity *= 2;
+        t->stack = realloc(t->stack, t->stack_capacity * sizeof(int32_t));
+    }
+
+    t->stack[(*top)++] = index;
+}
+
+static void push_result(struct bvh *t, size_t *count, uint32_t id)
+{
+    if (*count == t->results_capacity)
+    {
+        t->results_capacity *= 2;
+        t->results = realloc(t->results,
+                t->results_capacity * sizeof(uint32_t));
+    }
+
+    t->results[(*count)++] = id;
+}
+
+static bool ray_hits_bbox(struct vec3 origin, struct vec3 inv_dir,
+        float max_dist, struct bbox b)
+{
+    float tx1 = (b.x1 - origin.x) * inv_dir.x;
+    float tx2 = (b.x2 - origin.x) * inv_dir.x;
+    float ty1 = (b.y1 - origin.y) * inv_dir.y;
+    float ty2 = (b.y2 - origin.y) * inv_dir.y;
+    float tz1 = (b.z1 - origin.z) * inv_dir.z;
+    float tz2 = (b.z2 - origin.z) * inv_dir.z;
+
+    float tmin = fmaxf(fmaxf(fminf(tx1, tx2), fminf(ty1, ty2)),
+            fminf(tz1, tz2));
+    float tmax = fminf(fminf(fmaxf(tx1, tx2), fmaxf(ty1, ty2)),
+            fmaxf(tz1, tz2));
+
+    return tmax >= fmaxf(tmin, 0.0f) && tmin <= max_dist;
+}
+
+void bvh_init(struct bvh *t)
+{
+    t->capacity = BVH_START_CAPACITY;
+    t->nodes = malloc(t->capacity * sizeof(struct bvh_node));
+
+    t->stack_capacity = BVH_START_CAPACITY;
+    t->stack = malloc(t->stack_capacity * sizeof(int32_t));
+
+    t->results_capacity = BVH_START_CAPACITY;
+    t->results = malloc(t->results_capacity * sizeof(uint32_t));
+
+    bvh_clear(t);
+}
+
+void bvh_free(struct bvh *t)
+{
+    free(t->nodes);
+    free(t->stack);
+    free(t->results);
+}
+
+void bvh_clear(struct bvh *t)
+{
+    for (size_t i = 0; i < t->capacity; i++)
+    {
+        t->nodes[i].parent = i + 1 < t->capacity ?
+            (int32_t)(i + 1) : BVH_NULL_NODE;
+        t->nodes[i].height = -1;
+    }
+
+    t->free_list = 0;
+    t->root = BVH_NULL_NODE;
+    t->count = 0;
+}
+
+int32_t bvh_insert(struct bvh *t, uint32_t id, struct bbox box)
+{
+    int32_t proxy = alloc_node(t);
+
+    struct bvh_node *node = t->nodes + proxy;
+    node->box = bbox_fatten(box, VEC3_ZERO);
+    node->center = bbox_center(box);
+    node->id = id;
+
+    insert_leaf(t, proxy);
+    return proxy;
+}
+
+void bvh_remove(struct bvh *t, int32_t proxy)
+{
+    assert(is_leaf(t->nodes + proxy));
+
+    remove_leaf(t, proxy);
+    free_node(t, proxy);
+}
+
+bool bvh_move(struct bvh *t, int32_t proxy, struct bbox box)
+{
+    struct bvh_node *node = t->nodes + proxy;
+    assert(is_leaf(node));
+
+    struct vec3 center = bbox_center(box);
+    struct vec3 displacement = vec3_sub(center, node->center);
+    node->center = center;
+
+    struct bbox fat = bbox_fatten(box, displacement);
+    if (bbox_contains(node->box, box))
+    {
+        // Also reinsert when the leaf is much larger than needed,
+        // e.g. after the entry has been scaled down
+        struct bbox huge = bbox_enlarge(fat, 4.0f * BVH_FAT_MARGIN);
+        if (bbox_contains(huge, node->box))
+        {
+            return false;
+        }
+    }
+
+    remove_leaf(t, proxy);
+    t->nodes[proxy].box = fat;
+    insert_leaf(t, proxy);
+
+    return true;
+}
+
+size_t bvh_query(struct bvh *t, struct bbox box, const uint32_t **res)
+{
+    size_t count = 0;
+    size_t top = 0;
+
+    if (t->root != BVH_NULL_NODE)
+    {
+        push_stack(t, &top, t->root);
+    }
+
+    while (top)
+    {
+        const struct bvh_node *node = t->nodes + t->stack[--top];
+        if (!bbox_overlapping(node->box, box))
+        {
+            continue;
+        }
+
+        if (is_leaf(node))
+        {
+            push_result(t, &count, node->id);
+        }
+        else
+        {
+            int32_t left = node->left;
+            int32_t right = node->right;
+            push_stack(t, &top, left);
+            push_stack(t, &top, right);
+        }
+    }
+
+    *res = t->results;
+    return count;
+}
+
+size_t bvh_raycast(struct bvh *t, struct vec3 origin, struct vec3 dir,
+        float max_dist, const uint32_t **res)
+{
+    struct vec3 inv_dir = vec3_create(1.0f / dir.x, 1.0f / dir.y,
+            1.0f / dir.z);
+
+    size_t count = 0;
+    size_t top = 0;
+
+    if (t->root != BVH_NULL_NODE)
+    {
+        push_stack(t, &top, t->root);
+    }
+
+    while (top)
+    {
+        const struct bvh_node *node = t->nodes + t->stack[--top];
+        if (!ray_hits_bbox(origin, inv_dir, max_dist, node->box))
+        {
+            continue;
+        }
+
+        if (is_leaf(node))
+        {
+            push_result(t, &count, node->id);
+        }
+        else
+        {
+            int32_t left = node->left;
+            int32_t right = node->right;
+            push_stack(t, &top, left);
+            push_stack(t, &top, right);
+        }
+    }
+
+    *res = t->results;
+    return count;
+}
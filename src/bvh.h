@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "collide.h"
+
+#define BVH_NULL_NODE ((int32_t)-1)
+
+// Dynamic AABB tree with one leaf per entry. Leaves store fattened
+// bounds, so entries that move a little stay in place.
+struct bvh_node
+{
+    struct bbox box;
+    struct vec3 center;
+    int32_t parent;
+    int32_t left;
+    int32_t right;
+    int32_t height;
+    uint32_t id;
+};
+
+struct bvh
+{
+    struct bvh_node *nodes;
+    size_t capacity;
+    size_t count;
+    int32_t root;
+    int32_t free_list;
+
+    int32_t *stack;
+    size_t stack_capacity;
+
+    uint32_t *results;
+    size_t results_capacity;
+};
+
+void bvh_init(struct bvh *t);
+void bvh_free(struct bvh *t);
+void bvh_clear(struct bvh *t);
+
+int32_t bvh_insert(struct bvh *t, uint32_t id, struct bbox box);
+void bvh_remove(struct bvh *t, int32_t proxy);
+
+// Updates the bounds of a leaf, returns true if it had to be reinserted
+bool bvh_move(struct bvh *t, int32_t proxy, struct bbox box);
+
+// Query results are owned by the tree and valid until the next query
+size_t bvh_query(struct bvh *t, struct bbox box, const uint32_t **res);
+size_t bvh_raycast(struct bvh *t, struct vec3 origin, struct vec3 dir,
+        float max_dist, const uint32_t **res);
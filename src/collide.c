@@ -1,8 +1,21 @@
 #include "collide.h"
+#include <assert.h>
 #include <float.h>
 #include <math.h>
 #include "render.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// Keeps near parallel edge pairs from producing a zero cross axis that
+// separates everything
+#define OBB_EPSILON 1e-6f
+
+#define SPHERE_OUTLINE_SEGMENTS 24
+
+typedef bool(*shape_test)(const struct obb *a, const struct obb *b);
+
 struct cbox_info
 {
     struct vec3 axis_x;
@@ -18,34 +31,7 @@ struct cbox_prj
     float end;
 };
 
-struct bbox
-{
-    float x1, x2;
-    float y1, y2;
-    float z1, z2;
-};
-
-static struct bbox get_bbox(const struct actor *a)
-{
-    struct bbox res;
-
-    struct vec3 offset = vec3_vmul(a->cbox.offset, a->transform.scale);
-    struct vec3 center = vec3_add(a->transform.pos, offset);
-    struct vec3 delta = vec3_vmul(a->cbox.bounds, a->transform.scale);
-
-    float delta_max = fmax(fmax(delta.x, delta.y), delta.z);
-
-    res.x1 = center.x - delta_max;
-    res.x2 = center.x + delta_max;
-    res.y1 = center.y - delta_max;
-    res.y2 = center.y + delta_max;
-    res.z1 = center.z - delta_max;
-    res.z2 = center.z + delta_max;
-
-    return res;
-}
-
-static bool bbox_overlapping(struct bbox a, struct bbox b)
+bool bbox_overlapping(struct bbox a, struct bbox b)
 {
     return
         a.x1 <= b.x2 &&
@@ -56,27 +42,16 @@ static bool bbox_overlapping(struct bbox a, struct bbox b)
         a.z2 >= b.z1;
 }
 
-static bool check_broad_collide(const struct actor *a, const struct actor *b)
+static void get_cbox_info(struct cbox_info *info, const struct transform *t,
+        const struct cbox *c)
 {
-    struct bbox bbox_a = get_bbox(a);
-    struct bbox bbox_b = get_bbox(b);
-
-    return bbox_overlapping(bbox_a, bbox_b);
-}
-
-static void get_cbox_info(struct cbox_info *info, const struct actor *ac)
-{
-    info->axis_x = transform_right(&ac->transform);
-    info->axis_y = transform_up(&ac->transform);
-    info->axis_z = transform_forward(&ac->transform);
-    struct vec3 p = mat4_v3mul(transform_matrix(&ac->transform),
-            ac->cbox.offset);
-    struct vec3 dx = vec3_mul(info->axis_x,
-            ac->transform.scale.x * ac->cbox.bounds.x);
-    struct vec3 dy = vec3_mul(info->axis_y,
-            ac->transform.scale.y * ac->cbox.bounds.y);
-    struct vec3 dz = vec3_mul(info->axis_z,
-            ac->transform.scale.z * ac->cbox.bounds.z);
+    info->axis_x = transform_right(t);
+    info->axis_y = transform_up(t);
+    info->axis_z = transform_forward(t);
+    struct vec3 p = mat4_v3mul(transform_matrix(t), c->offset);
+    struct vec3 dx = vec3_mul(info->axis_x, t->scale.x * c->bounds.x);
+    struct vec3 dy = vec3_mul(info->axis_y, t->scale.y * c->bounds.y);
+    struct vec3 dz = vec3_mul(info->axis_z, t->scale.z * c->bounds.z);
 
     info->points[0] = vec3_add(vec3_add(vec3_sub(p, dx), dy), dz);
     info->points[1] = vec3_add(vec3_sub(vec3_sub(p, dx), dy), dz);
@@ -105,18 +80,550 @@ static struct cbox_prj get_cbox_projection(const struct cbox_info *info,
     return res;
 }
 
-bool check_collide(const struct actor *a, const struct actor *b)
+static float sphere_radius(const struct obb *o)
+{
+    return fmaxf(fmaxf(o->half.x, o->half.y), o->half.z);
+}
+
+void obb_init(struct obb *o, const struct transform *t, const struct cbox *c)
+{
+    o->center = mat4_v3mul(transform_matrix(t), c->offset);
+    o->axes[0] = transform_right(t);
+    o->axes[1] = transform_up(t);
+    o->axes[2] = transform_forward(t);
+    o->half = vec3_vmul(t->scale, c->bounds);
+}
+
+static struct bbox half_space_bbox(const struct obb *o)
+{
+    struct vec3 n = o->axes[2];
+    struct vec3 face = vec3_add(o->center, vec3_mul(n, o->half.z));
+    float normal[3] = {n.x, n.y, n.z};
+    float point[3] = {face.x, face.y, face.z};
+    float lo[3], hi[3];
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        lo[i] = -FLT_MAX;
+        hi[i] = FLT_MAX;
+
+        // Tilted faces leave the axis unbounded both ways
+        if (normal[i] > 1.0f - OBB_EPSILON)
+        {
+            hi[i] = point[i];
+        }
+        else if (normal[i] < -1.0f + OBB_EPSILON)
+        {
+            lo[i] = point[i];
+        }
+    }
+
+    struct bbox res;
+    res.x1 = lo[0];
+    res.x2 = hi[0];
+    res.y1 = lo[1];
+    res.y2 = hi[1];
+    res.z1 = lo[2];
+    res.z2 = hi[2];
+
+    return res;
+}
+
+struct bbox shape_bbox(enum collider_shape shape, const struct obb *o)
+{
+    if (shape == COLLIDER_HALF_SPACE)
+    {
+        return half_space_bbox(o);
+    }
+
+    struct vec3 extent;
+    if (shape == COLLIDER_SPHERE)
+    {
+        float r = sphere_radius(o);
+        extent = vec3_create(r, r, r);
+    }
+    else
+    {
+        // Each axis adds its half extent projected on the world axes
+        struct vec3 x = vec3_mul(o->axes[0], o->half.x);
+        struct vec3 y = vec3_mul(o->axes[1], o->half.y);
+        struct vec3 z = vec3_mul(o->axes[2], o->half.z);
+        extent.x = fabsf(x.x) + fabsf(y.x) + fabsf(z.x);
+        extent.y = fabsf(x.y) + fabsf(y.y) + fabsf(z.y);
+        extent.z = fabsf(x.z) + fabsf(y.z) + fabsf(z.z);
+    }
+
+    struct bbox res;
+    res.x1 = o->center.x - extent.x;
+    res.x2 = o->center.x + extent.x;
+    res.y1 = o->center.y - extent.y;
+    res.y2 = o->center.y + extent.y;
+    res.z1 = o->center.z - extent.z;
+    res.z2 = o->center.z + extent.z;
+
+    return res;
+}
+
+// Separating axis test in the projected radius form. Everything is
+// expressed in the frame of a, so only the distance between the centers
+// is projected instead of all the corners.
+bool check_obb(const struct obb *a, const struct obb *b)
+{
+    float ha[3] = {a->half.x, a->half.y, a->half.z};
+    float hb[3] = {b->half.x, b->half.y, b->half.z};
+
+    float r[3][3];
+    float abs_r[3][3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        for (size_t j = 0; j < 3; j++)
+        {
+            r[i][j] = vec3_dot(a->axes[i], b->axes[j]);
+            abs_r[i][j] = fabsf(r[i][j]) + OBB_EPSILON;
+        }
+    }
+
+    struct vec3 d = vec3_sub(b->center, a->center);
+    float t[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        t[i] = vec3_dot(d, a->axes[i]);
+    }
+
+    // Face axes of a
+    for (size_t i = 0; i < 3; i++)
+    {
+        float rb = hb[0] * abs_r[i][0] + hb[1] * abs_r[i][1] +
+            hb[2] * abs_r[i][2];
+        if (fabsf(t[i]) > ha[i] + rb)
+        {
+            return false;
+        }
+    }
+
+    // Face axes of b
+    for (size_t j = 0; j < 3; j++)
+    {
+        float ra = ha[0] * abs_r[0][j] + ha[1] * abs_r[1][j] +
+            ha[2] * abs_r[2][j];
+        float dist = t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j];
+        if (fabsf(dist) > ra + hb[j])
+        {
+            return false;
+        }
+    }
+
+    // Cross products of an edge of a and an edge of b
+    for (size_t i = 0; i < 3; i++)
+    {
+        size_t i1 = (i + 1) % 3;
+        size_t i2 = (i + 2) % 3;
+        for (size_t j = 0; j < 3; j++)
+        {
+            size_t j1 = (j + 1) % 3;
+            size_t j2 = (j + 2) % 3;
+            float ra = ha[i1] * abs_r[i2][j] + ha[i2] * abs_r[i1][j];
+            float rb = hb[j1] * abs_r[i][j2] + hb[j2] * abs_r[i][j1];
+            float dist = t[i2] * r[i1][j] - t[i1] * r[i2][j];
+            if (fabsf(dist) > ra + rb)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+#ifdef __SSE__
+
+static __m128 separated(__m128 dist, __m128 ra, __m128 rb)
+{
+    __m128 abs_dist = _mm_andnot_ps(_mm_set1_ps(-0.0f), dist);
+    return _mm_cmpgt_ps(abs_dist, _mm_add_ps(ra, rb));
+}
+
+// Same steps as check_obb with one of the other boxes in each lane, so
+// every lane gets the exact result check_obb would
+uint32_t check_obb_batch(const struct obb *a, const struct obb *const *others,
+        size_t count)
+{
+    assert(count > 0 && count <= OBB_BATCH_SIZE);
+
+    const struct obb *b[OBB_BATCH_SIZE];
+    for (size_t k = 0; k < OBB_BATCH_SIZE; k++)
+    {
+        b[k] = others[k < count ? k : 0];
+    }
+
+#define LANES(field) \
+    _mm_setr_ps(b[0]->field, b[1]->field, b[2]->field, b[3]->field)
+
+    __m128 center[3] = {LANES(center.x), LANES(center.y), LANES(center.z)};
+    __m128 axes[3][3] = {
+        {LANES(axes[0].x), LANES(axes[0].y), LANES(axes[0].z)},
+        {LANES(axes[1].x), LANES(axes[1].y), LANES(axes[1].z)},
+        {LANES(axes[2].x), LANES(axes[2].y), LANES(axes[2].z)},
+    };
+    __m128 hb[3] = {LANES(half.x), LANES(half.y), LANES(half.z)};
+
+#undef LANES
+
+    __m128 ha[3] = {
+        _mm_set1_ps(a->half.x),
+        _mm_set1_ps(a->half.y),
+        _mm_set1_ps(a->half.z),
+    };
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 epsilon = _mm_set1_ps(OBB_EPSILON);
+
+    __m128 r[3][3];
+    __m128 abs_r[3][3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        __m128 x = _mm_set1_ps(a->axes[i].x);
+        __m128 y = _mm_set1_ps(a->axes[i].y);
+        __m128 z = _mm_set1_ps(a->axes[i].z);
+        for (size_t j = 0; j < 3; j++)
+        {
+            r[i][j] = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(x, axes[j][0]),
+                        _mm_mul_ps(y, axes[j][1])),
+                    _mm_mul_ps(z, axes[j][2]));
+            abs_r[i][j] = _mm_add_ps(_mm_andnot_ps(sign, r[i][j]), epsilon);
+        }
+    }
+
+    __m128 d[3] = {
+        _mm_sub_ps(center[0], _mm_set1_ps(a->center.x)),
+        _mm_sub_ps(center[1], _mm_set1_ps(a->center.y)),
+        _mm_sub_ps(center[2], _mm_set1_ps(a->center.z)),
+    };
+    __m128 t[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        t[i] = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(d[0], _mm_set1_ps(a->axes[i].x)),
+                    _mm_mul_ps(d[1], _mm_set1_ps(a->axes[i].y))),
+                _mm_mul_ps(d[2], _mm_set1_ps(a->axes[i].z)));
+    }
+
+    int lanes = (1 << count) - 1;
+    __m128 sep = _mm_setzero_ps();
+
+    // Face axes of a
+    for (size_t i = 0; i < 3; i++)
+    {
+        __m128 rb = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(hb[0], abs_r[i][0]),
+                    _mm_mul_ps(hb[1], abs_r[i][1])),
+                _mm_mul_ps(hb[2], abs_r[i][2]));
+        sep = _mm_or_ps(sep, separated(t[i], ha[i], rb));
+    }
+
+    if ((_mm_movemask_ps(sep) & lanes) == lanes)
+    {
+        return 0;
+    }
+
+    // Face axes of b
+    for (size_t j = 0; j < 3; j++)
+    {
+        __m128 ra = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(ha[0], abs_r[0][j]),
+                    _mm_mul_ps(ha[1], abs_r[1][j])),
+                _mm_mul_ps(ha[2], abs_r[2][j]));
+        __m128 dist = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(t[0], r[0][j]),
+                    _mm_mul_ps(t[1], r[1][j])),
+                _mm_mul_ps(t[2], r[2][j]));
+        sep = _mm_or_ps(sep, separated(dist, ra, hb[j]));
+    }
+
+    if ((_mm_movemask_ps(sep) & lanes) == lanes)
+    {
+        return 0;
+    }
+
+    // Cross products of an edge of a and an edge of b
+    for (size_t i = 0; i < 3; i++)
+    {
+        size_t i1 = (i + 1) % 3;
+        size_t i2 = (i + 2) % 3;
+        for (size_t j = 0; j < 3; j++)
+        {
+            size_t j1 = (j + 1) % 3;
+            size_t j2 = (j + 2) % 3;
+            __m128 ra = _mm_add_ps(_mm_mul_ps(ha[i1], abs_r[i2][j]),
+                    _mm_mul_ps(ha[i2], abs_r[i1][j]));
+            __m128 rb = _mm_add_ps(_mm_mul_ps(hb[j1], abs_r[i][j2]),
+                    _mm_mul_ps(hb[j2], abs_r[i][j1]));
+            __m128 dist = _mm_sub_ps(_mm_mul_ps(t[i2], r[i1][j]),
+                    _mm_mul_ps(t[i1], r[i2][j]));
+            sep = _mm_or_ps(sep, separated(dist, ra, rb));
+        }
+    }
+
+    return ~_mm_movemask_ps(sep) & lanes;
+}
+
+#else
+
+uint32_t check_obb_batch(const struct obb *a, const struct obb *const *others,
+        size_t count)
+{
+    assert(count > 0 && count <= OBB_BATCH_SIZE);
+
+    uint32_t hits = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        if (check_obb(a, others[k]))
+        {
+            hits |= 1 << k;
+        }
+    }
+
+    return hits;
+}
+
+#endif
+
+void frustum_init(struct frustum *f, const struct mat4 *view_proj)
+{
+    const struct mat4 *m = view_proj;
+    struct vec4 x = vec4_create(m->m11, m->m12, m->m13, m->m14);
+    struct vec4 y = vec4_create(m->m21, m->m22, m->m23, m->m24);
+    struct vec4 z = vec4_create(m->m31, m->m32, m->m33, m->m34);
+    struct vec4 w = vec4_create(m->m41, m->m42, m->m43, m->m44);
+
+    // Clip space points inside have -w <= x, y, z <= w
+    struct vec4 rows[3] = {x, y, z};
+    for (size_t i = 0; i < 3; i++)
+    {
+        struct vec4 r = rows[i];
+        f->planes[i * 2] = vec4_create(w.x + r.x, w.y + r.y, w.z + r.z,
+                w.w + r.w);
+        f->planes[i * 2 + 1] = vec4_create(w.x - r.x, w.y - r.y,
+                w.z - r.z, w.w - r.w);
+    }
+
+    // Normalized so the plane distances are in world units
+    for (size_t i = 0; i < 6; i++)
+    {
+        struct vec4 *p = f->planes + i;
+        float length = vec3_length(vec3_create(p->x, p->y, p->z));
+        *p = vec4_div(*p, length);
+    }
+}
+
+bool check_frustum_sphere(const struct frustum *f, struct vec3 center,
+        float radius)
+{
+    for (size_t i = 0; i < 6; i++)
+    {
+        const struct vec4 *p = f->planes + i;
+        float dist = p->x * center.x + p->y * center.y + p->z * center.z +
+            p->w;
+        if (dist < -radius)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#ifdef __SSE__
+
+uint32_t check_frustum_spheres(const struct frustum *f,
+        const struct vec3 *centers, const float *radii, size_t count)
+{
+    assert(count > 0 && count <= FRUSTUM_BATCH_SIZE);
+
+    size_t k[FRUSTUM_BATCH_SIZE];
+    for (size_t i = 0; i < FRUSTUM_BATCH_SIZE; i++)
+    {
+        k[i] = i < count ? i : 0;
+    }
+
+    __m128 x = _mm_setr_ps(centers[k[0]].x, centers[k[1]].x,
+            centers[k[2]].x, centers[k[3]].x);
+    __m128 y = _mm_setr_ps(centers[k[0]].y, centers[k[1]].y,
+            centers[k[2]].y, centers[k[3]].y);
+    __m128 z = _mm_setr_ps(centers[k[0]].z, centers[k[1]].z,
+            centers[k[2]].z, centers[k[3]].z);
+    __m128 neg_radius = _mm_setr_ps(-radii[k[0]], -radii[k[1]],
+            -radii[k[2]], -radii[k[3]]);
+
+    __m128 outside = _mm_setzero_ps();
+    for (size_t i = 0; i < 6; i++)
+    {
+        const struct vec4 *p = f->planes + i;
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(x, _mm_set1_ps(p->x)),
+                        _mm_mul_ps(y, _mm_set1_ps(p->y))),
+                    _mm_mul_ps(z, _mm_set1_ps(p->z))),
+                _mm_set1_ps(p->w));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, neg_radius));
+    }
+
+    return ~_mm_movemask_ps(outside) & ((1 << count) - 1);
+}
+
+#else
+
+uint32_t check_frustum_spheres(const struct frustum *f,
+        const struct vec3 *centers, const float *radii, size_t count)
+{
+    assert(count > 0 && count <= FRUSTUM_BATCH_SIZE);
+
+    uint32_t hits = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (check_frustum_sphere(f, centers[i], radii[i]))
+        {
+            hits |= 1 << i;
+        }
+    }
+
+    return hits;
+}
+
+#endif
+
+// Signed distance of a point from the surface of a half-space
+static float half_space_dist(const struct obb *o, struct vec3 p)
+{
+    return vec3_dot(vec3_sub(p, o->center), o->axes[2]) - o->half.z;
+}
+
+static bool sphere_sphere(const struct obb *a, const struct obb *b)
+{
+    struct vec3 d = vec3_sub(b->center, a->center);
+    float r = sphere_radius(a) + sphere_radius(b);
+    return vec3_dot(d, d) <= r * r;
+}
+
+static bool sphere_obb(const struct obb *a, const struct obb *b)
+{
+    struct vec3 d = vec3_sub(a->center, b->center);
+    float half[3] = {b->half.x, b->half.y, b->half.z};
+
+    // Squared distance from the sphere center to the closest point
+    float dist = 0.0f;
+    for (size_t i = 0; i < 3; i++)
+    {
+        float excess = fabsf(vec3_dot(d, b->axes[i])) - half[i];
+        if (excess > 0.0f)
+        {
+            dist += excess * excess;
+        }
+    }
+
+    float r = sphere_radius(a);
+    return dist <= r * r;
+}
+
+static bool obb_sphere(const struct obb *a, const struct obb *b)
+{
+    return sphere_obb(b, a);
+}
+
+static bool sphere_half_space(const struct obb *a, const struct obb *b)
+{
+    return half_space_dist(b, a->center) <= sphere_radius(a);
+}
+
+static bool half_space_sphere(const struct obb *a, const struct obb *b)
+{
+    return sphere_half_space(b, a);
+}
+
+static bool obb_half_space(const struct obb *a, const struct obb *b)
+{
+    struct vec3 n = b->axes[2];
+    float r = a->half.x * fabsf(vec3_dot(a->axes[0], n)) +
+        a->half.y * fabsf(vec3_dot(a->axes[1], n)) +
+        a->half.z * fabsf(vec3_dot(a->axes[2], n));
+    return half_space_dist(b, a->center) <= r;
+}
+
+static bool half_space_obb(const struct obb *a, const struct obb *b)
+{
+    return obb_half_space(b, a);
+}
+
+// Two half-spaces only miss each other when they face away with a gap
+// between their surfaces
+static bool half_space_half_space(const struct obb *a, const struct obb *b)
+{
+    struct vec3 na = a->axes[2];
+    struct vec3 nb = b->axes[2];
+    if (vec3_dot(na, nb) > -1.0f + OBB_EPSILON)
+    {
+        return true;
+    }
+
+    struct vec3 surface = vec3_add(b->center, vec3_mul(nb, b->half.z));
+    return half_space_dist(a, surface) <= 0.0f;
+}
+
+static const shape_test shape_tests[COLLIDER_SHAPE_END][COLLIDER_SHAPE_END] =
+{
+    [COLLIDER_OBB] =
+    {
+        [COLLIDER_OBB] = check_obb,
+        [COLLIDER_SPHERE] = obb_sphere,
+        [COLLIDER_HALF_SPACE] = obb_half_space,
+    },
+    [COLLIDER_SPHERE] =
+    {
+        [COLLIDER_OBB] = sphere_obb,
+        [COLLIDER_SPHERE] = sphere_sphere,
+        [COLLIDER_HALF_SPACE] = sphere_half_space,
+    },
+    [COLLIDER_HALF_SPACE] =
+    {
+        [COLLIDER_OBB] = half_space_obb,
+        [COLLIDER_SPHERE] = half_space_sphere,
+        [COLLIDER_HALF_SPACE] = half_space_half_space,
+    },
+};
+
+bool check_shapes(enum collider_shape sa, const struct obb *a,
+        enum collider_shape sb, const struct obb *b)
+{
+    return shape_tests[sa][sb](a, b);
+}
+
+bool check_collide(const struct transform *ta, const struct cbox *ca,
+        const struct transform *tb, const struct cbox *cb)
 {
-    if (!check_broad_collide(a, b))
+    struct obb a;
+    obb_init(&a, ta, ca);
+
+    struct obb b;
+    obb_init(&b, tb, cb);
+
+    if (!bbox_overlapping(shape_bbox(COLLIDER_OBB, &a),
+                shape_bbox(COLLIDER_OBB, &b)))
     {
         return false;
     }
 
+    return check_obb(&a, &b);
+}
+
+// Projects all corners of both boxes on every axis, slower than
+// check_obb but kept to check it against
+bool check_collide_corners(const struct transform *ta, const struct cbox *ca,
+        const struct transform *tb, const struct cbox *cb)
+{
     struct cbox_info ainfo;
-    get_cbox_info(&ainfo, a);
+    get_cbox_info(&ainfo, ta, ca);
 
     struct cbox_info binfo;
-    get_cbox_info(&binfo, b);
+    get_cbox_info(&binfo, tb, cb);
 
     struct vec3 axes[15];
     axes[0] = ainfo.axis_x;
@@ -151,13 +658,71 @@ bool check_collide(const struct actor *a, const struct actor *b)
     return true;
 }
 
-void render_collider_outline(const struct actor *ac, float thickness,
+// Circles around the three axes of the box
+static void render_sphere_outline(const struct obb *o, float thickness,
+        struct color col)
+{
+    float r = sphere_radius(o);
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        struct vec3 u = vec3_mul(o->axes[(i + 1) % 3], r);
+        struct vec3 v = vec3_mul(o->axes[(i + 2) % 3], r);
+
+        struct vec3 prev = vec3_add(o->center, u);
+        for (size_t k = 1; k <= SPHERE_OUTLINE_SEGMENTS; k++)
+        {
+            float ang = 2.0f * M_PI * k / SPHERE_OUTLINE_SEGMENTS;
+            struct vec3 p = vec3_add(o->center, vec3_add(
+                        vec3_mul(u, cosf(ang)), vec3_mul(v, sinf(ang))));
+            render_push_untextured_line(prev, p, thickness, col);
+            prev = p;
+        }
+    }
+}
+
+// Outlines the surface and marks which way it faces
+static void render_half_space_outline(const struct cbox_info *info,
+        const struct obb *o, float thickness, struct color col)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        render_push_untextured_line(info->points[i],
+                info->points[(i + 1) % 4], thickness, col);
+    }
+
+    struct vec3 n = o->axes[2];
+    struct vec3 surface = vec3_add(o->center, vec3_mul(n, o->half.z));
+    float len = fmaxf(o->half.x, o->half.y) * 0.25f;
+    render_push_untextured_line(surface, vec3_add(surface, vec3_mul(n, len)),
+            thickness, col);
+}
+
+void render_collider_outline(enum collider_shape shape,
+        const struct transform *t, const struct cbox *c, float thickness,
         struct color col)
 {
     struct cbox_info info;
-    get_cbox_info(&info, ac);
+    get_cbox_info(&info, t, c);
 
-    render_push_untextured_volume_outline(info.points[0], info.points[1],
-            info.points[2], info.points[3], info.points[4], info.points[5],
-            info.points[6], info.points[7], thickness, col);
+    struct obb o;
+    obb_init(&o, t, c);
+
+    switch (shape)
+    {
+        case COLLIDER_OBB:
+            render_push_untextured_volume_outline(info.points[0],
+                    info.points[1], info.points[2], info.points[3],
+                    info.points[4], info.points[5], info.points[6],
+                    info.points[7], thickness, col);
+            break;
+        case COLLIDER_SPHERE:
+            render_sphere_outline(&o, thickness, col);
+            break;
+        case COLLIDER_HALF_SPACE:
+            render_half_space_outline(&info, &o, thickness, col);
+            break;
+        default:
+            break;
+    }
 }
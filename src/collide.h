@@ -1,6 +1,65 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include "actor.h"
 
-bool check_collide(const struct actor *a, const struct actor *b);
-void render_collider_outline(const struct actor *ac, float thickness, struct color col);
+// Number of boxes check_obb_batch tests at once
+#define OBB_BATCH_SIZE 4
+// Number of spheres check_frustum_spheres tests at once
+#define FRUSTUM_BATCH_SIZE 4
+
+struct bbox
+{
+    float x1, x2;
+    float y1, y2;
+    float z1, z2;
+};
+
+bool bbox_overlapping(struct bbox a, struct bbox b);
+
+// Collision box in world space with unit axes and half extents along
+// them. Spheres use the largest half extent as their radius around the
+// center, half-spaces are everything behind the face along the forward
+// axis.
+struct obb
+{
+    struct vec3 center;
+    struct vec3 axes[3];
+    struct vec3 half;
+};
+
+void obb_init(struct obb *o, const struct transform *t, const struct cbox *c);
+// Smallest world aligned box around the shape. Half-spaces are unbounded
+// on every side except the one a world aligned face closes.
+struct bbox shape_bbox(enum collider_shape shape, const struct obb *o);
+bool check_obb(const struct obb *a, const struct obb *b);
+// Tests a against up to OBB_BATCH_SIZE boxes, bit i of the result is set
+// if a hits others[i]
+uint32_t check_obb_batch(const struct obb *a, const struct obb *const *others,
+        size_t count);
+// Planes of a view volume facing inwards, points inside have
+// dot(xyz, p) + w >= 0 for all of them
+struct frustum
+{
+    struct vec4 planes[6];
+};
+
+// Extracts the planes from a projection times view matrix
+void frustum_init(struct frustum *f, const struct mat4 *view_proj);
+bool check_frustum_sphere(const struct frustum *f, struct vec3 center,
+        float radius);
+// Tests up to FRUSTUM_BATCH_SIZE spheres, bit i of the result is set if
+// sphere i is at least partly inside
+uint32_t check_frustum_spheres(const struct frustum *f,
+        const struct vec3 *centers, const float *radii, size_t count);
+
+bool check_shapes(enum collider_shape sa, const struct obb *a,
+        enum collider_shape sb, const struct obb *b);
+
+bool check_collide(const struct transform *ta, const struct cbox *ca,
+        const struct transform *tb, const struct cbox *cb);
+bool check_collide_corners(const struct transform *ta, const struct cbox *ca,
+        const struct transform *tb, const struct cbox *cb);
+void render_collider_outline(enum collider_shape shape,
+        const struct transform *t, const struct cbox *c, float thickness,
+        struct color col);
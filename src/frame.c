@@ -0,0 +1,112 @@
+#include "frame.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "log.h"
+
+#define FRAME_ALIGN 16
+
+// Allocations that did not fit the buffer, freed on reset
+struct frame_overflow
+{
+    struct frame_overflow *next;
+    size_t size;
+};
+
+uint8_t *frame_buf;
+size_t frame_size;
+size_t frame_used;
+
+struct frame_overflow *frame_overflows;
+size_t frame_overflow_used;
+
+size_t frame_high_water;
+
+static size_t align_up(size_t val)
+{
+    return (val + FRAME_ALIGN - 1) & ~(size_t)(FRAME_ALIGN - 1);
+}
+
+void frame_alloc_init(size_t size)
+{
+    frame_buf = malloc(size);
+    frame_size = size;
+    frame_used = 0;
+    frame_overflows = NULL;
+    frame_overflow_used = 0;
+    frame_high_water = 0;
+}
+
+void frame_alloc_shutdown()
+{
+    frame_alloc_reset();
+    free(frame_buf);
+    frame_buf = NULL;
+    frame_size = 0;
+}
+
+void frame_alloc_reset()
+{
+    size_t used = frame_used + frame_overflow_used;
+    if (used > frame_high_water)
+    {
+        if (frame_overflow_used)
+        {
+            log_warn("Frame allocator overflowed to the heap: %zu of %zu bytes",
+                    used, frame_size);
+        }
+        frame_high_water = used;
+    }
+
+    while (frame_overflows)
+    {
+        struct frame_overflow *next = frame_overflows->next;
+        free(frame_overflows);
+        frame_overflows = next;
+    }
+
+    frame_used = 0;
+    frame_overflow_used = 0;
+}
+
+void *frame_alloc(size_t size)
+{
+    size = align_up(size);
+
+    if (frame_used + size <= frame_size)
+    {
+        void *res = frame_buf + frame_used;
+        frame_used += size;
+        return res;
+    }
+
+    size_t header = align_up(sizeof(struct frame_overflow));
+    struct frame_overflow *o = malloc(header + size);
+    o->next = frame_overflows;
+    o->size = size;
+    frame_overflows = o;
+    frame_overflow_used += size;
+
+    return (uint8_t *)o + header;
+}
+
+char *frame_printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char *res = frame_alloc(len + 1);
+
+    va_start(args, fmt);
+    vsnprintf(res, len + 1, fmt, args);
+    va_end(args);
+
+    return res;
+}
+
+size_t frame_alloc_high_water()
+{
+    return frame_high_water;
+}
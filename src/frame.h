@@ -0,0 +1,18 @@
+#pragma once
+#include <stdlib.h>
+
+// Bytes reserved up front, frames that need more fall back to the heap
+#define FRAME_ALLOC_SIZE (1 << 20)
+
+// Linear allocator for memory that only lives until the end of the frame.
+// Everything is released by frame_alloc_reset, which runs in
+// timer_postupdate. Not thread safe.
+void frame_alloc_init(size_t size);
+void frame_alloc_shutdown();
+void frame_alloc_reset();
+
+void *frame_alloc(size_t size);
+char *frame_printf(const char *fmt, ...);
+
+// Most bytes handed out in a single frame, including heap fallbacks
+size_t frame_alloc_high_water();
@@ -10,6 +10,16 @@
 #include "timer.h"
 #include "log.h"
 #include "calc.h"
+#include "frame.h"
+#include "job.h"
+
+// Simulation ticks per second, independent of the frame rate
+#ifndef SIM_RATE
+#define SIM_RATE 60
+#endif
+
+// Most ticks run in one frame, time beyond that is dropped
+#define SIM_MAX_STEPS 5
 
 enum gstate
 {
@@ -26,6 +36,8 @@ float camera_free_mode_rspd;
 
 enum gstate state = GSTATE_MENU;
 
+float sim_accumulator;
+
 static void camera_free_mode_update(float dt)
 {
     if (key_pressed(GLFW_KEY_W))
@@ -75,6 +87,9 @@ bool game_init()
     if (!glfwInit())
         return false;
 
+    frame_alloc_init(FRAME_ALLOC_SIZE);
+    jobs_init(0);
+
     window = glfwCreateWindow(640, 480, GAME_NAME, NULL, NULL);
     if (!window)
     {
@@ -146,6 +161,7 @@ void game_run()
                 {
                     state = GSTATE_PLAY;
                     world_begin(&world);
+                    sim_accumulator = 0.0f;
                 }
 
                 menu_render();
@@ -167,6 +183,21 @@ void game_run()
                 {
                     toggle_collider_rendering(&world);
                 }
+                else if (key_pressed(GLFW_KEY_F9))
+                {
+                    toggle_broadphase(&world);
+                }
+                else if (key_pressed(GLFW_KEY_F8))
+                {
+                    toggle_frustum_culling(&world);
+                }
+                else if (key_pressed(GLFW_KEY_F7))
+                {
+                    toggle_mesh_pass(&world);
+                }
+
+                const float sim_dt = 1.0f / SIM_RATE;
+                float alpha = 1.0f;
 
                 if (camera_free_mode)
                 {
@@ -174,18 +205,47 @@ void game_run()
                 }
                 else
                 {
-                    world_update(&world, dt);
+                    sim_accumulator += dt;
+
+                    int steps = 0;
+                    while (sim_accumulator >= sim_dt &&
+                            steps < SIM_MAX_STEPS &&
+                            !world_should_end(&world))
+                    {
+                        world_update(&world, sim_dt);
+                        sim_accumulator -= sim_dt;
+                        steps++;
+                    }
+
+                    // Drop the backlog after a hitch instead of trying to
+                    // catch up with ever more ticks
+                    if (sim_accumulator >= sim_dt)
+                    {
+                        sim_accumulator = fmodf(sim_accumulator, sim_dt);
+                    }
+
+                    alpha = sim_accumulator / sim_dt;
+                    world_camera_view(&world, alpha);
                 }
 
-                world_render(&world);
+                render_reset_stats();
+                world_render(&world, alpha);
+                struct render_stats rstats = render_get_stats();
 
-                static char dinfo[256];
                 struct vec3 cpos = get_camera()->transform.pos;
-                snprintf(dinfo, 256,
+                char *dinfo = frame_printf(
                         "Frame time: %.2fms\nFPS: %d\n"
-                        "Camera pos: (%.2f, %.2f, %.2f)",
+                        "Camera pos: (%.2f, %.2f, %.2f)\n"
+                        "Frame mem peak: %zuKB\n"
+                        "Instances: %zu drawn, %zu culled\n"
+                        "Draw calls: %zu (%zu cached statics), "
+                        "state changes: %zu",
                         dt * 100.0f, timer_fps(),
-                        cpos.x, cpos.y, cpos.z);
+                        cpos.x, cpos.y, cpos.z,
+                        frame_alloc_high_water() / 1024,
+                        world.drawn_instances, world.culled_instances,
+                        rstats.draw_calls, rstats.cached_draw_calls,
+                        rstats.state_changes);
 
                 render_ui_begin();
                 render_push_ui_text(dinfo, vec2_create(1300.0f, 1060.0f),
@@ -217,6 +277,8 @@ void game_shutdown()
     assets_free();
     render_shutdown();
     audio_shutdown();
+    frame_alloc_shutdown();
+    jobs_shutdown();
     glfwTerminate();
 }
 
@@ -0,0 +1,291 @@
+#include "grid.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define GRID_START_CAPACITY     256
+#define GRID_MIN_CELL_SIZE      0.25f
+#define GRID_MAX_CELLS          64
+#define GRID_MAX_QUERY_CELLS    4096
+
+struct cell_range
+{
+    int x1, x2;
+    int y1, y2;
+    int z1, z2;
+};
+
+static struct cell_range get_cell_range(const struct grid *g,
+        struct bbox box)
+{
+    struct cell_range res;
+    float inv = 1.0f / g->cell_size;
+
+    res.x1 = floorf(box.x1 * inv);
+    res.x2 = floorf(box.x2 * inv);
+    res.y1 = floorf(box.y1 * inv);
+    res.y2 = floorf(box.y2 * inv);
+    res.z1 = floorf(box.z1 * inv);
+    res.z2 = floorf(box.z2 * inv);
+
+    return res;
+}
+
+static size_t cell_range_count(struct cell_range r)
+{
+    return (size_t)(r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1) * (r.z2 - r.z1 + 1);
+}
+
+static uint32_t cell_hash(const struct grid *g, int x, int y, int z)
+{
+    uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^
+        (uint32_t)z * 83492791u;
+    return h & g->bucket_mask;
+}
+
+static size_t next_pow2(size_t val)
+{
+    size_t res = 1;
+    while (res < val)
+    {
+        res <<= 1;
+    }
+
+    return res;
+}
+
+static void next_stamp(struct grid *g)
+{
+    g->stamp++;
+    if (!g->stamp)
+    {
+        memset(g->stamps, 0, g->capacity * sizeof(uint32_t));
+        g->stamp = 1;
+    }
+}
+
+static bool check_entry(struct grid *g, uint32_t entry, struct bbox box)
+{
+    if (g->stamps[entry] == g->stamp)
+    {
+        return false;
+    }
+
+    g->stamps[entry] = g->stamp;
+    return bbox_overlapping(g->boxes[entry], box);
+}
+
+void grid_init(struct grid *g)
+{
+    g->cell_size = GRID_MIN_CELL_SIZE;
+
+    g->capacity = GRID_START_CAPACITY;
+    g->count = 0;
+    g->ids = malloc(g->capacity * sizeof(uint32_t));
+    g->boxes = malloc(g->capacity * sizeof(struct bbox));
+    g->oversized = malloc(g->capacity * sizeof(uint32_t));
+    g->stamps = calloc(g->capacity, sizeof(uint32_t));
+    g->results = malloc(g->capacity * sizeof(uint32_t));
+    g->oversized_count = 0;
+    g->stamp = 0;
+
+    g->bucket_capacity = 0;
+    g->bucket_mask = 0;
+    g->bucket_start = NULL;
+
+    g->cell_capacity = 0;
+    g->cells = NULL;
+}
+
+void grid_free(struct grid *g)
+{
+    free(g->ids);
+    free(g->boxes);
+    free(g->oversized);
+    free(g->stamps);
+    free(g->results);
+    free(g->bucket_start);
+    free(g->cells);
+}
+
+void grid_clear(struct grid *g)
+{
+    g->count = 0;
+    g->oversized_count = 0;
+}
+
+void grid_add(struct grid *g, uint32_t id, struct bbox box)
+{
+    if (g->count == g->capacity)
+    {
+        size_t old_capacity = g->capacity;
+        g->capacity *= 2;
+
+        g->ids = realloc(g->ids, g->capacity * sizeof(uint32_t));
+        g->boxes = realloc(g->boxes, g->capacity * sizeof(struct bbox));
+        g->oversized = realloc(g->oversized,
+                g->capacity * sizeof(uint32_t));
+        g->results = realloc(g->results, g->capacity * sizeof(uint32_t));
+        g->stamps = realloc(g->stamps, g->capacity * sizeof(uint32_t));
+        memset(g->stamps + old_capacity, 0,
+                (g->capacity - old_capacity) * sizeof(uint32_t));
+    }
+
+    g->ids[g->count] = id;
+    g->boxes[g->count] = box;
+    g->count++;
+}
+
+void grid_build(struct grid *g)
+{
+    g->oversized_count = 0;
+    if (!g->count)
+    {
+        return;
+    }
+
+    // Cell size is twice the mean entry diameter, so a typical entry
+    // only overlaps a handful of cells
+    float diameter_sum = 0.0f;
+    for (size_t i = 0; i < g->count; i++)
+    {
+        struct bbox b = g->boxes[i];
+        diameter_sum += fmaxf(fmaxf(b.x2 - b.x1, b.y2 - b.y1), b.z2 - b.z1);
+    }
+    g->cell_size = fmaxf(2.0f * diameter_sum / g->count, GRID_MIN_CELL_SIZE);
+
+    size_t cell_count = 0;
+    for (size_t i = 0; i < g->count; i++)
+    {
+        size_t n = cell_range_count(get_cell_range(g, g->boxes[i]));
+        if (n > GRID_MAX_CELLS)
+        {
+            g->oversized[g->oversized_count++] = i;
+        }
+        else
+        {
+            cell_count += n;
+        }
+    }
+
+    size_t bucket_count = next_pow2(cell_count * 2);
+    if (bucket_count + 1 > g->bucket_capacity)
+    {
+        g->bucket_capacity = bucket_count + 1;
+        free(g->bucket_start);
+        g->bucket_start = malloc(g->bucket_capacity * sizeof(uint32_t));
+    }
+    if (cell_count > g->cell_capacity)
+    {
+        g->cell_capacity = next_pow2(cell_count);
+        free(g->cells);
+        g->cells = malloc(g->cell_capacity * sizeof(uint32_t));
+    }
+
+    g->bucket_mask = bucket_count - 1;
+    memset(g->bucket_start, 0, (bucket_count + 1) * sizeof(uint32_t));
+
+    // Count entries per bucket, turn the counts into end offsets and
+    // then fill backwards so that each offset ends up at the bucket start
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        size_t next_oversized = 0;
+        for (size_t i = 0; i < g->count; i++)
+        {
+            if (next_oversized < g->oversized_count &&
+                    g->oversized[next_oversized] == i)
+            {
+                next_oversized++;
+                continue;
+            }
+
+            struct cell_range r = get_cell_range(g, g->boxes[i]);
+            for (int z = r.z1; z <= r.z2; z++)
+            {
+                for (int y = r.y1; y <= r.y2; y++)
+                {
+                    for (int x = r.x1; x <= r.x2; x++)
+                    {
+                        uint32_t h = cell_hash(g, x, y, z);
+                        if (pass == 0)
+                        {
+                            g->bucket_start[h]++;
+                        }
+                        else
+                        {
+                            g->cells[--g->bucket_start[h]] = i;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            for (size_t b = 1; b <= bucket_count; b++)
+            {
+                g->bucket_start[b] += g->bucket_start[b - 1];
+            }
+        }
+    }
+
+    assert(g->bucket_start[bucket_count] == cell_count);
+}
+
+size_t grid_query(struct grid *g, struct bbox box, const uint32_t **res)
+{
+    *res = g->results;
+    if (!g->count)
+    {
+        return 0;
+    }
+
+    next_stamp(g);
+    size_t n = 0;
+
+    struct cell_range r = get_cell_range(g, box);
+    if (cell_range_count(r) > GRID_MAX_QUERY_CELLS)
+    {
+        // Visiting the cells would be slower than testing every entry
+        for (size_t i = 0; i < g->count; i++)
+        {
+            if (bbox_overlapping(g->boxes[i], box))
+            {
+                g->results[n++] = g->ids[i];
+            }
+        }
+
+        return n;
+    }
+
+    for (int z = r.z1; z <= r.z2; z++)
+    {
+        for (int y = r.y1; y <= r.y2; y++)
+        {
+            for (int x = r.x1; x <= r.x2; x++)
+            {
+                uint32_t h = cell_hash(g, x, y, z);
+                for (uint32_t c = g->bucket_start[h];
+                        c < g->bucket_start[h + 1]; c++)
+                {
+                    uint32_t entry = g->cells[c];
+                    if (check_entry(g, entry, box))
+                    {
+                        g->results[n++] = g->ids[entry];
+                    }
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < g->oversized_count; i++)
+    {
+        uint32_t entry = g->oversized[i];
+        if (check_entry(g, entry, box))
+        {
+            g->results[n++] = g->ids[entry];
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "collide.h"
+
+// Spatial hash over uniform cells. Entries are added every tick and the
+// grid is rebuilt in one counting sort pass by grid_build.
+struct grid
+{
+    float cell_size;
+
+    uint32_t *ids;
+    struct bbox *boxes;
+    size_t count;
+    size_t capacity;
+
+    uint32_t *bucket_start;
+    uint32_t bucket_mask;
+    size_t bucket_capacity;
+
+    uint32_t *cells;
+    size_t cell_capacity;
+
+    // Entries spanning too many cells, tested against every query
+    uint32_t *oversized;
+    size_t oversized_count;
+
+    uint32_t *stamps;
+    uint32_t stamp;
+
+    uint32_t *results;
+};
+
+void grid_init(struct grid *g);
+void grid_free(struct grid *g);
+
+void grid_clear(struct grid *g);
+void grid_add(struct grid *g, uint32_t id, struct bbox box);
+void grid_build(struct grid *g);
+
+// Returns the ids of all entries overlapping box. The result array is
+// owned by the grid and only valid until the next query.
+size_t grid_query(struct grid *g, struct bbox box, const uint32_t **res);
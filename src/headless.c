@@ -0,0 +1,631 @@
+#include "headless.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "world.h"
+#include "collide.h"
+#include "calc.h"
+#include "job.h"
+#include "log.h"
+#include "frame.h"
+
+#define DEFAULT_TICKS   1000
+#define DEFAULT_DT      (1.0f / 60.0f)
+#define DEFAULT_SEED    1
+
+// Each box in the collision benchmark is tested against this many others
+#define BENCH_NEIGHBORS 8
+// The math benchmark cycles through this many inputs so they stay in cache
+#define BENCH_MATH_SET  1024
+
+static const char *broadphase_names[BROADPHASE_END] =
+{
+    "brute-force",
+    "grid",
+    "bvh",
+    "sap",
+};
+
+struct headless_options
+{
+    uint32_t orbs;
+    uint32_t max_actors;
+    uint32_t ticks;
+    float dt;
+    uint32_t seed;
+    uint32_t workers;
+    // BROADPHASE_END keeps the world's default
+    enum broadphase broadphase;
+    bool verify_narrowphase;
+    uint32_t bench_collide;
+    uint32_t bench_math;
+};
+
+static void print_usage()
+{
+    printf("Usage: asteroids --headless [options]\n"
+            "  --orbs N         Number of orbs to spawn (default %d)\n"
+            "  --max-actors N   Limit on live actors (default %d)\n"
+            "  --ticks N        Number of ticks to simulate (default %d)\n"
+            "  --dt SECONDS     Length of a tick (default %f)\n"
+            "  --seed N         Seed for the random generator (default %d)\n"
+            "  --workers N      Job worker threads, 0 for one per core "
+            "(default 0)\n"
+            "  --broadphase NAME\n"
+            "                   One of brute-force, grid, bvh or sap "
+            "(default WORLD_BROADPHASE)\n"
+            "  --verify-narrowphase\n"
+            "                   Check parallel collision tests against "
+            "serial ones\n"
+            "  --bench-collide N\n"
+            "                   Time the collision tests on N random boxes "
+            "instead\n"
+            "  --bench-math N   Time N of each SIMD math operation against "
+            "the scalar\n"
+            "                   versions instead\n",
+            ORB_COUNT, MAX_ACTORS, DEFAULT_TICKS, DEFAULT_DT, DEFAULT_SEED);
+}
+
+static bool parse_options(struct headless_options *opts, int argc,
+        char **argv)
+{
+    opts->orbs = ORB_COUNT;
+    opts->max_actors = MAX_ACTORS;
+    opts->ticks = DEFAULT_TICKS;
+    opts->dt = DEFAULT_DT;
+    opts->seed = DEFAULT_SEED;
+    opts->workers = 0;
+    opts->broadphase = BROADPHASE_END;
+    opts->verify_narrowphase = false;
+    opts->bench_collide = 0;
+    opts->bench_math = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--verify-narrowphase") == 0)
+        {
+            opts->verify_narrowphase = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            log_err("Missing value for %s", arg);
+            return false;
+        }
+
+        const char *val = argv[++i];
+        if (strcmp(arg, "--orbs") == 0)
+        {
+            opts->orbs = strtoul(val, NULL, 10);
+        }
+        else if (strcmp(arg, "--max-actors") == 0)
+        {
+            opts->max_actors = strtoul(val, NULL, 10);
+        }
+        else if (strcmp(arg, "--ticks") == 0)
+        {
+            opts->ticks = strtoul(val, NULL, 10);
+        }
+        else if (strcmp(arg, "--dt") == 0)
+        {
+            opts->dt = strtof(val, NULL);
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            opts->seed = strtoul(val, NULL, 10);
+        }
+        else if (strcmp(arg, "--workers") == 0)
+        {
+            opts->workers = strtoul(val, NULL, 10);
+        }
+        else if (strcmp(arg, "--broadphase") == 0)
+        {
+            for (opts->broadphase = 0; opts->broadphase < BROADPHASE_END;
+                    opts->broadphase++)
+            {
+                if (strcmp(val, broadphase_names[opts->broadphase]) == 0)
+                {
+                    break;
+                }
+            }
+
+            if (opts->broadphase == BROADPHASE_END)
+            {
+                log_err("Unknown broadphase %s", val);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--bench-collide") == 0)
+        {
+            opts->bench_collide = strtoul(val, NULL, 10);
+        }
+        else if (strcmp(arg, "--bench-math") == 0)
+        {
+            opts->bench_math = strtoul(val, NULL, 10);
+        }
+        else
+        {
+            log_err("Unknown option %s", arg);
+            return false;
+        }
+    }
+
+    if (!opts->ticks || opts->dt <= 0.0f)
+    {
+        log_err("Tick count and dt must be positive");
+        return false;
+    }
+
+    // The walls and the player are spawned alongside the orbs
+    if (opts->max_actors < 7 || opts->orbs > opts->max_actors - 7)
+    {
+        log_err("%u orbs do not fit in %u actors", opts->orbs,
+                opts->max_actors);
+        return false;
+    }
+
+    return true;
+}
+
+static double elapsed_ms(const struct timespec *start,
+        const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 +
+        (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static double percentile(const double *sorted, size_t count, double p)
+{
+    size_t i = (size_t)(p * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+static void random_box(struct transform *t, struct cbox *c)
+{
+    transform_init(t, vec3_create(frandrange(-5.0f, 5.0f),
+                frandrange(-5.0f, 5.0f), frandrange(-5.0f, 5.0f)));
+    struct vec3 axis = vec3_normalize(vec3_create(frandrange(-1.0f, 1.0f),
+                frandrange(-1.0f, 1.0f), frandrange(-1.0f, 1.0f)));
+    t->rot = quat_axis_angle(axis, frandrange(0.0f, 2.0f * M_PI));
+    t->scale = vec3_create(frandrange(0.5f, 2.0f), frandrange(0.5f, 2.0f),
+            frandrange(0.5f, 2.0f));
+
+    cbox_init(c);
+}
+
+// Compares the corner projection test with the scalar and batched OBB
+// tests on the same random pairs
+static int bench_collide(uint32_t count)
+{
+    if (count <= BENCH_NEIGHBORS)
+    {
+        log_err("Collision benchmark needs more than %d boxes",
+                BENCH_NEIGHBORS);
+        return EXIT_FAILURE;
+    }
+
+    struct transform *transforms = malloc(count * sizeof(struct transform));
+    struct cbox *cboxes = malloc(count * sizeof(struct cbox));
+    struct obb *obbs = malloc(count * sizeof(struct obb));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        random_box(transforms + i, cboxes + i);
+        obb_init(obbs + i, transforms + i, cboxes + i);
+    }
+
+    size_t tests = (size_t)count * BENCH_NEIGHBORS;
+    uint8_t *corner_hits = malloc(tests);
+    uint8_t *obb_hits = malloc(tests);
+    uint8_t *batch_hits = malloc(tests);
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t k = 0; k < BENCH_NEIGHBORS; k++)
+        {
+            uint32_t j = (i + k + 1) % count;
+            corner_hits[i * BENCH_NEIGHBORS + k] = check_collide_corners(
+                    transforms + i, cboxes + i, transforms + j, cboxes + j);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double corner_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t k = 0; k < BENCH_NEIGHBORS; k++)
+        {
+            uint32_t j = (i + k + 1) % count;
+            obb_hits[i * BENCH_NEIGHBORS + k] = check_obb(obbs + i,
+                    obbs + j);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double obb_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t k = 0; k < BENCH_NEIGHBORS; k += OBB_BATCH_SIZE)
+        {
+            const struct obb *others[OBB_BATCH_SIZE];
+            for (uint32_t n = 0; n < OBB_BATCH_SIZE; n++)
+            {
+                others[n] = obbs + (i + k + n + 1) % count;
+            }
+
+            uint32_t hits = check_obb_batch(obbs + i, others,
+                    OBB_BATCH_SIZE);
+            for (uint32_t n = 0; n < OBB_BATCH_SIZE; n++)
+            {
+                batch_hits[i * BENCH_NEIGHBORS + k + n] = hits >> n & 1;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double batch_ms = elapsed_ms(&start, &end);
+
+    size_t hits = 0;
+    size_t obb_mismatches = 0;
+    size_t batch_mismatches = 0;
+    for (size_t i = 0; i < tests; i++)
+    {
+        hits += corner_hits[i];
+        obb_mismatches += obb_hits[i] != corner_hits[i];
+        batch_mismatches += batch_hits[i] != obb_hits[i];
+    }
+
+    printf("boxes: %u, tests: %zu, hits: %zu\n", count, tests, hits);
+    printf("corners: %.3fms, %.1fns per test\n", corner_ms,
+            corner_ms * 1e6 / tests);
+    printf("obb: %.3fms, %.1fns per test, %zu differ from corners\n",
+            obb_ms, obb_ms * 1e6 / tests, obb_mismatches);
+    printf("obb batch of %d: %.3fms, %.1fns per test, %zu differ from obb\n",
+            OBB_BATCH_SIZE, batch_ms, batch_ms * 1e6 / tests,
+            batch_mismatches);
+
+    free(transforms);
+    free(cboxes);
+    free(obbs);
+    free(corner_hits);
+    free(obb_hits);
+    free(batch_hits);
+
+    return batch_mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static struct quat random_quat()
+{
+    return quat_create(frandrange(-1.0f, 1.0f), frandrange(-1.0f, 1.0f),
+            frandrange(-1.0f, 1.0f), frandrange(-1.0f, 1.0f));
+}
+
+static float max_difference(const float *a, const float *b, size_t count)
+{
+    float diff = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        diff = fmaxf(diff, fabsf(a[i] - b[i]));
+    }
+
+    return diff;
+}
+
+static void print_math_op(const char *name, uint32_t count, double scalar_ms,
+        double simd_ms, float diff)
+{
+    printf("%-16s scalar %.2fns, simd %.2fns, %.2fx, max difference %g\n",
+            name, scalar_ms * 1e6 / count, simd_ms * 1e6 / count,
+            scalar_ms / simd_ms, diff);
+}
+
+// Times the inline math with and without its SIMD paths on the same random
+// inputs
+static int bench_math(uint32_t count)
+{
+    uint32_t rounds = (count + BENCH_MATH_SET - 1) / BENCH_MATH_SET;
+    count = rounds * BENCH_MATH_SET;
+
+    struct mat4 *mats = malloc(BENCH_MATH_SET * sizeof(struct mat4));
+    struct vec4 *vecs = malloc(BENCH_MATH_SET * sizeof(struct vec4));
+    struct quat *quats = malloc(BENCH_MATH_SET * sizeof(struct quat));
+    struct vec3 *positions = malloc(BENCH_MATH_SET * sizeof(struct vec3));
+    struct quat *rotations = malloc(BENCH_MATH_SET * sizeof(struct quat));
+    struct vec3 *scales = malloc(BENCH_MATH_SET * sizeof(struct vec3));
+    for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+    {
+        struct transform t;
+        struct cbox c;
+        random_box(&t, &c);
+        mats[i] = transform_matrix(&t);
+        positions[i] = t.pos;
+        rotations[i] = t.rot;
+        scales[i] = t.scale;
+        vecs[i] = vec4_create(frandrange(-5.0f, 5.0f),
+                frandrange(-5.0f, 5.0f), frandrange(-5.0f, 5.0f), 1.0f);
+        quats[i] = random_quat();
+    }
+
+    struct mat4 *scalar_mats = malloc(BENCH_MATH_SET * sizeof(struct mat4));
+    struct mat4 *simd_mats = malloc(BENCH_MATH_SET * sizeof(struct mat4));
+    struct vec4 *scalar_vecs = malloc(BENCH_MATH_SET * sizeof(struct vec4));
+    struct vec4 *simd_vecs = malloc(BENCH_MATH_SET * sizeof(struct vec4));
+    struct quat *scalar_quats = malloc(BENCH_MATH_SET * sizeof(struct quat));
+    struct quat *simd_quats = malloc(BENCH_MATH_SET * sizeof(struct quat));
+    float *scalar_dots = malloc(BENCH_MATH_SET * sizeof(float));
+    float *simd_dots = malloc(BENCH_MATH_SET * sizeof(float));
+    struct timespec start, end;
+
+#ifdef VECTOR_SIMD
+    printf("ops: %u, simd enabled\n", count);
+#else
+    printf("ops: %u, simd disabled\n", count);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            mat4_mul_scalar(scalar_mats + i, mats + i,
+                    mats + (i + 1) % BENCH_MATH_SET);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double scalar_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            mat4_mul_ptr(simd_mats + i, mats + i,
+                    mats + (i + 1) % BENCH_MATH_SET);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_math_op("mat4 * mat4", count, scalar_ms, elapsed_ms(&start, &end),
+            max_difference(scalar_mats->vals, simd_mats->vals,
+                BENCH_MATH_SET * 16));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            scalar_vecs[i] = mat4_v4mul_scalar(mats + i, vecs[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    scalar_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            simd_vecs[i] = mat4_v4mul_ptr(mats + i, vecs[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_math_op("mat4 * vec4", count, scalar_ms, elapsed_ms(&start, &end),
+            max_difference(&scalar_vecs->x, &simd_vecs->x,
+                BENCH_MATH_SET * 4));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            scalar_dots[i] = quat_dot_scalar(quats[i],
+                    quats[(i + 1) % BENCH_MATH_SET]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    scalar_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            simd_dots[i] = quat_dot(quats[i],
+                    quats[(i + 1) % BENCH_MATH_SET]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_math_op("quat dot", count, scalar_ms, elapsed_ms(&start, &end),
+            max_difference(scalar_dots, simd_dots,
+                BENCH_MATH_SET));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            scalar_quats[i] = quat_normalize_scalar(quats[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    scalar_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            simd_quats[i] = quat_normalize(quats[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_math_op("quat normalize", count, scalar_ms,
+            elapsed_ms(&start, &end), max_difference(&scalar_quats->x,
+                &simd_quats->x, BENCH_MATH_SET * 4));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (uint32_t i = 0; i < BENCH_MATH_SET; i++)
+        {
+            struct transform t = { positions[i], scales[i], rotations[i] };
+            scalar_mats[i] = transform_matrix(&t);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    scalar_ms = elapsed_ms(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        transform_matrices(simd_mats, positions, rotations, scales,
+                BENCH_MATH_SET);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_math_op("transform matrix", count, scalar_ms,
+            elapsed_ms(&start, &end), max_difference(scalar_mats->vals,
+                simd_mats->vals, BENCH_MATH_SET * 16));
+
+    free(mats);
+    free(vecs);
+    free(quats);
+    free(positions);
+    free(rotations);
+    free(scales);
+    free(scalar_mats);
+    free(simd_mats);
+    free(scalar_vecs);
+    free(simd_vecs);
+    free(scalar_quats);
+    free(simd_quats);
+    free(scalar_dots);
+    free(simd_dots);
+
+    return EXIT_SUCCESS;
+}
+
+int headless_run(int argc, char **argv)
+{
+    struct headless_options opts;
+    if (!parse_options(&opts, argc, argv))
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    srand(opts.seed);
+    if (opts.bench_collide)
+    {
+        return bench_collide(opts.bench_collide);
+    }
+
+    if (opts.bench_math)
+    {
+        return bench_math(opts.bench_math);
+    }
+
+    actor_types_init();
+    jobs_init(opts.workers);
+    frame_alloc_init(FRAME_ALLOC_SIZE);
+
+    struct world world;
+    world_init(&world);
+    world.orb_count = opts.orbs;
+    world.verify_narrowphase = opts.verify_narrowphase;
+    world.max_actors = opts.max_actors;
+    if (opts.broadphase != BROADPHASE_END)
+    {
+        world.broadphase = opts.broadphase;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    world_begin(&world);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double begin_ms = elapsed_ms(&start, &end);
+
+    jobs_reset_stats();
+
+    double *times = malloc(opts.ticks * sizeof(double));
+    double total = 0.0;
+    int64_t death_tick = -1;
+
+    for (uint32_t i = 0; i < opts.ticks; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        world_update(&world, opts.dt);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        times[i] = elapsed_ms(&start, &end);
+        total += times[i];
+
+        // Every tick counts as a frame for the frame allocator
+        frame_alloc_reset();
+
+        if (death_tick < 0 && world_should_end(&world))
+        {
+            death_tick = i;
+        }
+    }
+
+    uint32_t actors_left = world.num_actors;
+
+    struct job_stats stats;
+    jobs_stats(&stats);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    world_end(&world);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double end_ms = elapsed_ms(&start, &end);
+
+    qsort(times, opts.ticks, sizeof(double), compare_doubles);
+
+    printf("orbs: %u, ticks: %u, dt: %f, seed: %u, workers: %u\n",
+            opts.orbs, opts.ticks, opts.dt, opts.seed, jobs_worker_count());
+    printf("broadphase: %s\n", broadphase_names[world.broadphase]);
+    printf("world_begin: %.3fms, world_end: %.3fms\n", begin_ms, end_ms);
+    printf("tick total: %.3fms\n", total);
+    printf("tick mean: %.3fms, min: %.3fms, max: %.3fms\n",
+            total / opts.ticks, times[0], times[opts.ticks - 1]);
+    printf("tick p50: %.3fms, p95: %.3fms, p99: %.3fms\n",
+            percentile(times, opts.ticks, 0.50),
+            percentile(times, opts.ticks, 0.95),
+            percentile(times, opts.ticks, 0.99));
+    printf("actors left: %u\n", actors_left);
+    printf("frame mem peak: %zuKB\n", frame_alloc_high_water() / 1024);
+    if (death_tick >= 0)
+    {
+        printf("player died on tick %lld\n", (long long)death_tick);
+    }
+
+    printf("jobs: %llu, steals: %llu, idle: %.3fms\n",
+            (unsigned long long)stats.jobs, (unsigned long long)stats.steals,
+            stats.idle_ms);
+    for (uint32_t i = 0; i < jobs_worker_count(); i++)
+    {
+        struct job_stats ws;
+        jobs_worker_stats(i, &ws);
+        printf("  worker %u: jobs: %llu, steals: %llu, idle: %.3fms\n", i,
+                (unsigned long long)ws.jobs, (unsigned long long)ws.steals,
+                ws.idle_ms);
+    }
+
+    free(times);
+    world_free(&world);
+    frame_alloc_shutdown();
+    jobs_shutdown();
+
+    return EXIT_SUCCESS;
+}
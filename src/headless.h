@@ -0,0 +1,5 @@
+#pragma once
+
+// Runs the simulation without a window, renderer or audio and prints
+// tick timing stats. Takes the arguments following --headless.
+int headless_run(int argc, char **argv);
@@ -0,0 +1,443 @@
+#include "job.h"
+#include <assert.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "log.h"
+
+#define JOB_MAX_WORKERS 64
+#define JOB_QUEUE_SIZE  1024
+
+// Jobs are pushed and popped at the bottom by the owner, other workers
+// steal from the top
+struct job_queue
+{
+    pthread_mutex_t lock;
+    struct job jobs[JOB_QUEUE_SIZE];
+    size_t top;
+    size_t bottom;
+};
+
+struct worker
+{
+    pthread_t thread;
+    struct job_queue queue;
+    uint32_t index;
+
+    atomic_uint_fast64_t jobs;
+    atomic_uint_fast64_t steals;
+    atomic_uint_fast64_t idle_ns;
+};
+
+struct worker workers[JOB_MAX_WORKERS];
+uint32_t worker_count;
+
+atomic_bool jobs_running;
+atomic_int jobs_queued;
+pthread_mutex_t sleep_lock;
+pthread_cond_t sleep_cond;
+
+_Thread_local uint32_t worker_index;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool queue_push(struct job_queue *q, const struct job *job)
+{
+    pthread_mutex_lock(&q->lock);
+
+    bool res = q->bottom - q->top < JOB_QUEUE_SIZE;
+    if (res)
+    {
+        q->jobs[q->bottom % JOB_QUEUE_SIZE] = *job;
+        q->bottom++;
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
+
+static bool queue_pop(struct job_queue *q, struct job *job)
+{
+    pthread_mutex_lock(&q->lock);
+
+    bool res = q->bottom != q->top;
+    if (res)
+    {
+        q->bottom--;
+        *job = q->jobs[q->bottom % JOB_QUEUE_SIZE];
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
+
+static bool queue_steal(struct job_queue *q, struct job *job)
+{
+    pthread_mutex_lock(&q->lock);
+
+    bool res = q->bottom != q->top;
+    if (res)
+    {
+        *job = q->jobs[q->top % JOB_QUEUE_SIZE];
+        q->top++;
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
+
+static void execute(struct job *job);
+
+static void push_job(const struct job *job)
+{
+    struct worker *w = workers + worker_index;
+    if (!worker_count || !queue_push(&w->queue, job))
+    {
+        // No workers or the queue is full, so run the job right away
+        struct job copy = *job;
+        execute(&copy);
+        return;
+    }
+
+    atomic_fetch_add(&jobs_queued, 1);
+
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_signal(&sleep_cond);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+static void finish_job(struct job_counter *c)
+{
+    if (!c)
+    {
+        return;
+    }
+
+    // The counter is not touched after unlocking, since a waiter may
+    // free it as soon as it reaches zero
+    size_t count = 0;
+    struct job deferred[JOB_MAX_DEFERRED];
+
+    pthread_mutex_lock(&c->lock);
+    if (atomic_fetch_sub(&c->pending, 1) == 1)
+    {
+        count = c->deferred_count;
+        for (size_t i = 0; i < count; i++)
+        {
+            deferred[i] = c->deferred[i];
+        }
+        c->deferred_count = 0;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        push_job(deferred + i);
+    }
+}
+
+static void execute(struct job *job)
+{
+    job->func(job->arg, job->start, job->end);
+    if (worker_count)
+    {
+        atomic_fetch_add(&workers[worker_index].jobs, 1);
+    }
+    finish_job(job->counter);
+}
+
+static bool get_job(struct job *job)
+{
+    struct worker *self = workers + worker_index;
+    if (queue_pop(&self->queue, job))
+    {
+        atomic_fetch_sub(&jobs_queued, 1);
+        return true;
+    }
+
+    for (uint32_t i = 1; i < worker_count; i++)
+    {
+        struct worker *victim = workers + (worker_index + i) % worker_count;
+        if (queue_steal(&victim->queue, job))
+        {
+            atomic_fetch_sub(&jobs_queued, 1);
+            atomic_fetch_add(&self->steals, 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *self = arg;
+    worker_index = self->index;
+
+    while (atomic_load(&jobs_running))
+    {
+        struct job job;
+        if (get_job(&job))
+        {
+            execute(&job);
+            continue;
+        }
+
+        uint64_t idle_start = now_ns();
+
+        pthread_mutex_lock(&sleep_lock);
+        while (atomic_load(&jobs_queued) <= 0 && atomic_load(&jobs_running))
+        {
+            pthread_cond_wait(&sleep_cond, &sleep_lock);
+        }
+        pthread_mutex_unlock(&sleep_lock);
+
+        atomic_fetch_add(&self->idle_ns, now_ns() - idle_start);
+    }
+
+    return NULL;
+}
+
+void jobs_init(uint32_t count)
+{
+    if (!count)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cores > 0 ? cores : 1;
+    }
+    if (count > JOB_MAX_WORKERS)
+    {
+        count = JOB_MAX_WORKERS;
+    }
+
+    worker_count = count;
+    worker_index = 0;
+    atomic_store(&jobs_running, true);
+    atomic_store(&jobs_queued, 0);
+    pthread_mutex_init(&sleep_lock, NULL);
+    pthread_cond_init(&sleep_cond, NULL);
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        struct worker *w = workers + i;
+        pthread_mutex_init(&w->queue.lock, NULL);
+        w->queue.top = 0;
+        w->queue.bottom = 0;
+        w->index = i;
+        atomic_store(&w->jobs, 0);
+        atomic_store(&w->steals, 0);
+        atomic_store(&w->idle_ns, 0);
+    }
+
+    // Worker 0 is the calling thread
+    for (uint32_t i = 1; i < worker_count; i++)
+    {
+        if (pthread_create(&workers[i].thread, NULL, worker_main,
+                    workers + i))
+        {
+            log_warn("Failed to start job worker %u", i);
+            worker_count = i;
+            break;
+        }
+    }
+
+    log_info("Job system started with %u workers", worker_count);
+}
+
+void jobs_shutdown()
+{
+    pthread_mutex_lock(&sleep_lock);
+    atomic_store(&jobs_running, false);
+    pthread_cond_broadcast(&sleep_cond);
+    pthread_mutex_unlock(&sleep_lock);
+
+    for (uint32_t i = 1; i < worker_count; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        pthread_mutex_destroy(&workers[i].queue.lock);
+    }
+    pthread_mutex_destroy(&sleep_lock);
+    pthread_cond_destroy(&sleep_cond);
+    worker_count = 0;
+}
+
+uint32_t jobs_worker_count()
+{
+    return worker_count;
+}
+
+void job_counter_init(struct job_counter *c)
+{
+    atomic_store(&c->pending, 0);
+    pthread_mutex_init(&c->lock, NULL);
+    c->deferred_count = 0;
+}
+
+void job_counter_free(struct job_counter *c)
+{
+    assert(atomic_load(&c->pending) == 0);
+    pthread_mutex_destroy(&c->lock);
+}
+
+void job_run(job_func func, void *arg, struct job_counter *counter)
+{
+    struct job job;
+    job.func = func;
+    job.arg = arg;
+    job.start = 0;
+    job.end = 0;
+    job.counter = counter;
+
+    if (counter)
+    {
+        atomic_fetch_add(&counter->pending, 1);
+    }
+
+    push_job(&job);
+}
+
+void job_run_after(struct job_counter *dependency, job_func func, void *arg,
+        struct job_counter *counter)
+{
+    struct job job;
+    job.func = func;
+    job.arg = arg;
+    job.start = 0;
+    job.end = 0;
+    job.counter = counter;
+
+    if (counter)
+    {
+        atomic_fetch_add(&counter->pending, 1);
+    }
+
+    pthread_mutex_lock(&dependency->lock);
+    if (atomic_load(&dependency->pending) > 0)
+    {
+        assert(dependency->deferred_count < JOB_MAX_DEFERRED);
+        dependency->deferred[dependency->deferred_count++] = job;
+        pthread_mutex_unlock(&dependency->lock);
+        return;
+    }
+    pthread_mutex_unlock(&dependency->lock);
+
+    push_job(&job);
+}
+
+void job_wait(struct job_counter *counter)
+{
+    while (atomic_load(&counter->pending) > 0)
+    {
+        struct job job;
+        if (get_job(&job))
+        {
+            execute(&job);
+        }
+        else
+        {
+            // The remaining jobs are running on other workers
+            uint64_t idle_start = now_ns();
+            sched_yield();
+            atomic_fetch_add(&workers[worker_index].idle_ns,
+                    now_ns() - idle_start);
+        }
+    }
+
+    // Wait for the last finishing job to release the counter
+    pthread_mutex_lock(&counter->lock);
+    pthread_mutex_unlock(&counter->lock);
+}
+
+void job_parallel_for(size_t count, size_t grain, job_func func, void *arg)
+{
+    if (!count)
+    {
+        return;
+    }
+
+    if (worker_count <= 1)
+    {
+        func(arg, 0, count);
+        return;
+    }
+
+    // A few ranges per worker so that stealing can even out the load
+    size_t ranges = worker_count * 4;
+    size_t size = (count + ranges - 1) / ranges;
+    if (size < grain)
+    {
+        size = grain;
+    }
+
+    if (size >= count)
+    {
+        func(arg, 0, count);
+        return;
+    }
+
+    struct job_counter counter;
+    job_counter_init(&counter);
+
+    struct job job;
+    job.func = func;
+    job.arg = arg;
+    job.counter = &counter;
+
+    // The first range is kept for the calling thread
+    for (size_t start = size; start < count; start += size)
+    {
+        job.start = start;
+        job.end = start + size < count ? start + size : count;
+        atomic_fetch_add(&counter.pending, 1);
+        push_job(&job);
+    }
+
+    func(arg, 0, size);
+    atomic_fetch_add(&workers[worker_index].jobs, 1);
+
+    job_wait(&counter);
+    job_counter_free(&counter);
+}
+
+void jobs_worker_stats(uint32_t worker, struct job_stats *stats)
+{
+    const struct worker *w = workers + worker;
+    stats->jobs = atomic_load(&w->jobs);
+    stats->steals = atomic_load(&w->steals);
+    stats->idle_ms = atomic_load(&w->idle_ns) / 1e6;
+}
+
+void jobs_stats(struct job_stats *stats)
+{
+    stats->jobs = 0;
+    stats->steals = 0;
+    stats->idle_ms = 0.0;
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        struct job_stats ws;
+        jobs_worker_stats(i, &ws);
+        stats->jobs += ws.jobs;
+        stats->steals += ws.steals;
+        stats->idle_ms += ws.idle_ms;
+    }
+}
+
+void jobs_reset_stats()
+{
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        atomic_store(&workers[i].jobs, 0);
+        atomic_store(&workers[i].steals, 0);
+        atomic_store(&workers[i].idle_ns, 0);
+    }
+}
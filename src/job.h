@@ -0,0 +1,63 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define JOB_MAX_DEFERRED 64
+
+typedef void(*job_func)(void *arg, size_t start, size_t end);
+
+struct job
+{
+    job_func func;
+    void *arg;
+    size_t start;
+    size_t end;
+    struct job_counter *counter;
+};
+
+// Number of unfinished jobs, also holds jobs waiting for it to reach zero
+struct job_counter
+{
+    atomic_int pending;
+    pthread_mutex_t lock;
+    struct job deferred[JOB_MAX_DEFERRED];
+    size_t deferred_count;
+};
+
+struct job_stats
+{
+    uint64_t jobs;
+    uint64_t steals;
+    double idle_ms;
+};
+
+// Starts the worker threads, 0 uses one thread per core. The calling
+// thread counts as a worker and runs jobs while waiting.
+void jobs_init(uint32_t worker_count);
+void jobs_shutdown();
+uint32_t jobs_worker_count();
+
+void job_counter_init(struct job_counter *c);
+void job_counter_free(struct job_counter *c);
+
+// Counter may be NULL for fire and forget jobs
+void job_run(job_func func, void *arg, struct job_counter *counter);
+
+// Queues the job once dependency reaches zero
+void job_run_after(struct job_counter *dependency, job_func func, void *arg,
+        struct job_counter *counter);
+
+// Runs other jobs until counter reaches zero
+void job_wait(struct job_counter *counter);
+
+// Splits [0, count) into ranges of at least grain items and waits for all
+// of them to finish
+void job_parallel_for(size_t count, size_t grain, job_func func, void *arg);
+
+// Stats are summed over all workers since the last reset
+void jobs_stats(struct job_stats *stats);
+void jobs_worker_stats(uint32_t worker, struct job_stats *stats);
+void jobs_reset_stats();
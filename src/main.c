@@ -1,8 +1,15 @@
 #include <stdlib.h>
+#include <string.h>
 #include "game.h"
+#include "headless.h"
 
-int main()
+int main(int argc, char **argv)
 {
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+    {
+        return headless_run(argc - 2, argv + 2);
+    }
+
     if (!game_init())
     {
         return EXIT_FAILURE;
@@ -27,6 +27,9 @@ void mesh_init(struct mesh *mesh, size_t vertex_count, size_t tri_count)
     mesh->vertices = malloc(vertex_count * sizeof(struct vert_mesh));
     mesh->indices = malloc(mesh->index_count * sizeof(GLuint));
 
+    mesh->radius = 0.0f;
+    mesh->base_vertex = 0;
+    mesh->first_index = 0;
     mesh->texture = NULL;
 }
 
@@ -36,6 +39,17 @@ void mesh_free(struct mesh *mesh)
     free(mesh->vertices);
 }
 
+void mesh_update_radius(struct mesh *mesh)
+{
+    float r2 = 0.0f;
+    for (size_t i = 0; i < mesh->vertex_count; i++)
+    {
+        r2 = fmaxf(r2, vec3_length2(mesh->vertices[i].pos));
+    }
+
+    mesh->radius = sqrtf(r2);
+}
+
 struct mesh create_quad_mesh()
 {
     struct mesh quad_mesh;
@@ -49,6 +63,7 @@ struct mesh create_quad_mesh()
     add_triangle(&quad_mesh, 0, 0, 2, 1);
     add_triangle(&quad_mesh, 1, 0, 3, 2);
 
+    mesh_update_radius(&quad_mesh);
     return quad_mesh;
 }
 
@@ -104,6 +119,7 @@ struct mesh create_cube_mesh()
     add_triangle(&cube_mesh, 10, 12, 22, 13);
     add_triangle(&cube_mesh, 11, 15, 23, 16);
 
+    mesh_update_radius(&cube_mesh);
     return cube_mesh;
 }
 
@@ -163,5 +179,6 @@ struct mesh create_icosahedron_mesh()
     add_triangle(&mesh, 18, 5, 11, 4);
     add_triangle(&mesh, 19, 10, 8, 4);
 
+    mesh_update_radius(&mesh);
     return mesh;
 }
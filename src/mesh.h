@@ -16,11 +16,18 @@ struct mesh
     GLuint *indices;
     size_t vertex_count;
     size_t index_count;
+    // Distance of the furthest vertex from the origin
+    float radius;
+    // Offsets into the renderer's merged buffers, set when uploaded
+    GLint base_vertex;
+    size_t first_index;
     const struct texture *texture;
 };
 
 void mesh_init(struct mesh *mesh, size_t vertex_count, size_t tri_count);
 void mesh_free(struct mesh *mesh);
+// Call once the vertices are filled in
+void mesh_update_radius(struct mesh *mesh);
 
 struct mesh create_quad_mesh();
 struct mesh create_cube_mesh();
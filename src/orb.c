@@ -2,25 +2,22 @@
 #include <math.h>
 #include "collide.h"
 #include "player.h"
+#include "job.h"
 
 #define SPD_NORM            2.0f
 #define ACCEL_NORM          1.0f
 #define ATTRACT_SPD_MAX     1.0f
 #define ATTRACT_RANGE       1.5f
 #define ATTRACT_ACCEL_MAX   2.0f
+#define ORB_JOB_GRAIN       1024
 
-struct orb_data
+void orb_on_collide(struct world *w, struct actor *ac, struct actor *hit)
 {
-    struct vec3 vel;
-    struct vec3 dir;
-};
-
-static void on_collide(struct actor *ac, struct actor *hit)
-{
-    struct orb_data *data = ac->data;
+    struct orb_data *data = actor_data(w, ac);
     if (hit->type == ACTOR_TYPE_WALL)
     {
-        struct vec3 norm = transform_forward(&hit->transform);
+        struct transform t = actor_transform(w, hit);
+        struct vec3 norm = transform_forward(&t);
         if (vec3_dot(norm, data->dir) <= 0.0f)
         {
             data->dir = vec3_reflect(data->dir, norm);
@@ -35,40 +32,72 @@ static void on_collide(struct actor *ac, struct actor *hit)
 void spawn_orb(struct world *w, struct vec3 pos)
 {
     struct actor *ac = new_actor(w, pos, ACTOR_TYPE_ORB);
-    vec3_div_eq(&ac->transform.scale, 8.0f);
+    ac->shape = COLLIDER_SPHERE;
 
-    ac->on_collide = on_collide;
+    struct actor_group *g = w->groups + ACTOR_TYPE_ORB;
+    size_t i = actor_index(w, ac);
+    vec3_div_eq(g->scales + i, 8.0f);
 
-    struct orb_data *data = malloc(sizeof(struct orb_data));
-    data->vel = VEC3_ZERO;
+    struct orb_data *data = actor_data(w, ac);
     data->dir = vec3_rand();
-
-    ac->data = data;
 }
 
-void orb_update(struct actor *ac, float dt)
+struct orb_pass
 {
-    struct orb_data *data = ac->data;
+    struct actor_group *g;
+    struct vec3 ppos;
+    bool has_player;
+    float dt;
+};
 
-    struct vec3 target_vel = vec3_mul(data->dir, SPD_NORM);
-    float accel = ACCEL_NORM;
+// Each orb only reads the player and writes its own state, so ranges of
+// orbs can be integrated on any thread
+static void integrate_orbs(void *arg, size_t start, size_t end)
+{
+    const struct orb_pass *pass = arg;
+    struct actor_group *g = pass->g;
+    const struct orb_data *data = g->data;
+    float dt = pass->dt;
 
-    struct actor *player = ac->world->player;
-    if (player)
+    for (size_t i = start; i < end; i++)
     {
-        struct vec3 ppos = player->transform.pos;
-        struct vec3 diff = vec3_sub(ppos, ac->transform.pos);
+        struct vec3 target_vel = vec3_mul(data[i].dir, SPD_NORM);
+        float accel = ACCEL_NORM;
 
-        float len = vec3_length(diff);
-        if (len < ATTRACT_RANGE)
+        if (pass->has_player)
         {
-            struct vec3 dir = vec3_div(diff, len);
-            target_vel = vec3_mul(dir, ATTRACT_SPD_MAX);
-            accel =
-                ((ATTRACT_RANGE - len) / ATTRACT_RANGE) * ATTRACT_ACCEL_MAX;
+            struct vec3 diff = vec3_sub(pass->ppos, g->positions[i]);
+
+            float len = vec3_length(diff);
+            if (len < ATTRACT_RANGE)
+            {
+                struct vec3 dir = vec3_div(diff, len);
+                target_vel = vec3_mul(dir, ATTRACT_SPD_MAX);
+                accel =
+                    ((ATTRACT_RANGE - len) / ATTRACT_RANGE) * ATTRACT_ACCEL_MAX;
+            }
         }
+
+        g->velocities[i] = vec3_approach(g->velocities[i], target_vel,
+                accel * dt);
+        vec3_add_eq(g->positions + i, vec3_mul(g->velocities[i], dt));
+    }
+}
+
+void orb_update(struct world *w, float dt)
+{
+    struct orb_pass pass;
+    pass.g = w->groups + ACTOR_TYPE_ORB;
+    pass.ppos = VEC3_ZERO;
+    pass.has_player = w->player != NULL;
+    pass.dt = dt;
+
+    if (w->player)
+    {
+        struct actor_group *pg = w->groups + ACTOR_TYPE_PLAYER;
+        pass.ppos = pg->positions[actor_index(w, w->player)];
     }
 
-    data->vel = vec3_approach(data->vel, target_vel, accel * dt);
-    vec3_add_eq(&ac->transform.pos, vec3_mul(data->vel, dt));
+    job_parallel_for(pass.g->num_ticking, ORB_JOB_GRAIN, integrate_orbs,
+            &pass);
 }
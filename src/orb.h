@@ -2,5 +2,11 @@
 #include "actor.h"
 #include "world.h"
 
+struct orb_data
+{
+    struct vec3 dir;
+};
+
 void spawn_orb(struct world *w, struct vec3 pos);
-void orb_update(struct actor *ac, float dt);
+void orb_update(struct world *w, float dt);
+void orb_on_collide(struct world *w, struct actor *ac, struct actor *hit);
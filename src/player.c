@@ -4,6 +4,7 @@
 #include "render.h"
 #include "input.h"
 #include "calc.h"
+#include "frame.h"
 
 #define SPD_BASE           10.0f
 #define SCALE               1.0f
@@ -24,26 +25,16 @@
 #define LOOK_ANG_MAX_BASE   0.05f
 #define LOOK_ANG_SPD_BASE   0.3f
 
-struct player_data
-{
-    float spd;
-    struct vec2 ang_spd;
-    struct vec2 look_ang;
-    uint32_t orb_level;
-    uint32_t orb_amount;
-    float fuel;
-};
-
-static uint32_t calculate_orb_target(struct player_data *data)
+static uint32_t calculate_orb_target(const struct player_data *data)
 {
     return ORB_TARGET_START + data->orb_level * ORB_TARGET_MUL;
 }
 
-static void on_collide(struct actor *ac, struct actor *hit)
+void player_on_collide(struct world *w, struct actor *ac, struct actor *hit)
 {
     if (hit->type == ACTOR_TYPE_ORB)
     {
-        struct player_data *data = ac->data;
+        struct player_data *data = actor_data(w, ac);
         data->orb_amount++;
 
         uint32_t orb_target = calculate_orb_target(data);
@@ -65,11 +56,11 @@ static void on_collide(struct actor *ac, struct actor *hit)
 struct actor *spawn_player(struct world *w, struct vec3 pos)
 {
     struct actor *ac = new_actor(w, pos, ACTOR_TYPE_PLAYER);
-    ac->transform.scale = vec3_create(SCALE, SCALE, SCALE);
-    ac->collide_mask = actor_type_bit(ACTOR_TYPE_ORB);
-    ac->on_collide = on_collide;
 
-    struct player_data *data = malloc(sizeof(struct player_data));
+    struct actor_group *g = w->groups + ACTOR_TYPE_PLAYER;
+    g->scales[actor_index(w, ac)] = vec3_create(SCALE, SCALE, SCALE);
+
+    struct player_data *data = actor_data(w, ac);
     data->spd = SPD_BASE;
     data->ang_spd = VEC2_ZERO;
     data->look_ang = VEC2_ZERO;
@@ -77,14 +68,13 @@ struct actor *spawn_player(struct world *w, struct vec3 pos)
     data->orb_amount = 0;
     data->fuel = FUEL_MAX;
 
-    ac->data = data;
-
     return ac;
 }
 
-void player_update(struct actor *ac, float dt)
+static void update_player(struct actor_group *g, size_t i, float dt)
 {
-    struct player_data *data = ac->data;
+    struct actor *ac = g->actors + i;
+    struct player_data *data = (struct player_data *)g->data + i;
 
     if (data->fuel < 0.0f)
     {
@@ -127,14 +117,16 @@ void player_update(struct actor *ac, float dt)
                 ang_deaccel * dt);
     }
 
-    transform_local_rotx(&ac->transform, data->ang_spd.x * dt);
-    transform_local_roty(&ac->transform, data->ang_spd.y * dt);
+    struct quat *rot = g->rotations + i;
+    *rot = quat_mul(*rot, quat_axis_angle(VEC3_RIGHT, data->ang_spd.x * dt));
+    *rot = quat_mul(*rot, quat_axis_angle(VEC3_UP, data->ang_spd.y * dt));
+    *rot = quat_normalize(*rot);
 
     float speed_target = SPD_BASE * powf(ORB_SPD_MUL, data->orb_level);
     data->spd = approach(data->spd, speed_target, ACCEL * dt);
 
-    struct vec3 fwd = transform_forward(&ac->transform);
-    vec3_add_eq(&ac->transform.pos, vec3_mul(fwd, data->spd * dt));
+    struct vec3 fwd = quat_basis_z(*rot);
+    vec3_add_eq(g->positions + i, vec3_mul(fwd, data->spd * dt));
 
     // Rotate the camera towards the direction the player want's to travel
     // Don't change look angle if the direction change is small
@@ -158,21 +150,32 @@ void player_update(struct actor *ac, float dt)
     data->fuel -= dt * FUEL_DEPLETE_RATE;
 }
 
-void player_camera_view(struct actor *ac, struct camera *cam, float dt)
+void player_update(struct world *w, float dt)
+{
+    struct actor_group *g = w->groups + ACTOR_TYPE_PLAYER;
+    for (size_t i = 0; i < g->num_ticking; i++)
+    {
+        update_player(g, i, dt);
+    }
+}
+
+void player_camera_view(struct world *w, struct actor *ac,
+        const struct transform *t, struct camera *cam)
 {
-    struct player_data *data = ac->data;
+    struct player_data *data = actor_data(w, ac);
 
-    cam->transform.pos = ac->transform.pos;
-    cam->transform.rot = ac->transform.rot;
+    cam->transform.pos = t->pos;
+    cam->transform.rot = t->rot;
 
     transform_local_rotx(&cam->transform, data->look_ang.x);
     transform_local_roty(&cam->transform, data->look_ang.y);
 }
 
-void player_render_hud(struct actor *ac, struct camera *cam)
+void player_render_hud(struct world *w, struct actor *ac,
+        const struct transform *t, struct camera *cam)
 {
-    struct vec3 fwd = transform_forward(&ac->transform);
-    struct vec3 wpos = vec3_add(ac->transform.pos, fwd);
+    struct vec3 fwd = transform_forward(t);
+    struct vec3 wpos = vec3_add(t->pos, fwd);
 
     const float foffset = 24.0f;
     const float chsize = 0.5f;
@@ -187,24 +190,23 @@ void player_render_hud(struct actor *ac, struct camera *cam)
     screen_center.y = UI_HEIGHT / 2.0f + foffset * chsize;
     render_push_ui_text("x", screen_center, chsize, COLOR_GREEN);
 
-    struct player_data *data = ac->data;
-    static char sfuel[32];
-    snprintf(sfuel, 32, "%.2f", data->fuel);
+    struct player_data *data = actor_data(w, ac);
+    char *sfuel = frame_printf("%.2f", data->fuel);
     render_push_ui_text(sfuel,
             vec2_create(screen_center.x - 32.0f, screen_center.y - 100.0f),
             chsize, COLOR_GREEN);
 }
 
-void player_render_state_info(struct actor *ac)
+void player_render_state_info(struct world *w, struct actor *ac)
 {
-    struct player_data *data = ac->data;
+    struct player_data *data = actor_data(w, ac);
 
-    struct vec3 pos = ac->transform.pos;
-    struct vec3 fwd = transform_forward(&ac->transform);
+    struct transform t = actor_transform(w, ac);
+    struct vec3 pos = t.pos;
+    struct vec3 fwd = transform_forward(&t);
     uint32_t orb_target = calculate_orb_target(data);
 
-    static char pinfo[256];
-    snprintf(pinfo, 256, "Pos: (%f, %f, %f)\n"
+    char *pinfo = frame_printf("Pos: (%f, %f, %f)\n"
             "Forward: (%f, %f, %f)\nSpd: %f\nAng Spd: (%f, %f)\nOrb: %d/%d\n",
             pos.x, pos.y, pos.z, fwd.x, fwd.y, fwd.z,
             data->spd, data->ang_spd.x, data->ang_spd.y,
@@ -3,8 +3,21 @@
 #include "world.h"
 #include "camera.h"
 
+struct player_data
+{
+    float spd;
+    struct vec2 ang_spd;
+    struct vec2 look_ang;
+    uint32_t orb_level;
+    uint32_t orb_amount;
+    float fuel;
+};
+
 struct actor *spawn_player(struct world *w, struct vec3 pos);
-void player_update(struct actor *ac, float dt);
-void player_camera_view(struct actor *ac, struct camera *cam, float dt);
-void player_render_hud(struct actor *ac, struct camera *cam);
-void player_render_state_info(struct actor *ac);
+void player_update(struct world *w, float dt);
+void player_on_collide(struct world *w, struct actor *ac, struct actor *hit);
+void player_camera_view(struct world *w, struct actor *ac,
+        const struct transform *t, struct camera *cam);
+void player_render_hud(struct world *w, struct actor *ac,
+        const struct transform *t, struct camera *cam);
+void player_render_state_info(struct world *w, struct actor *ac);
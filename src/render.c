@@ -1,6 +1,7 @@
 #include "render.h"
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include "shader.h"
 #include "asset.h"
 #include "vertex.h"
@@ -19,15 +20,60 @@
 #define FOV (M_PI / 4.0f)
 #define ASPECT_RATIO (1920.0f / 1080.0f)
 
-#define MAX_MESH_VERTICES 10000
-#define MAX_MESH_INDICES 15000
-#define MAX_MESH_INSTANCES 30000
+#define MAX_INSTANCE_CACHES 8
+#define MAX_MESH_COMMANDS 64
 
+// Per segment of the streams, longer batches are drawn in several calls
 #define MAX_UI_VERTICES 1000
 #define MAX_UI_INDICES 2000
 
-#define MAX_UNTEXTURED_VERTICES 30000000
-#define MAX_UNTEXTURED_INDICES 50000000
+#define MAX_UNTEXTURED_VERTICES (1 << 20)
+#define MAX_UNTEXTURED_INDICES (3 << 19)
+
+// Instances of a batch that rarely changes, kept in their own buffer
+struct instance_cache
+{
+    struct vao vao;
+    struct vbo models;
+    const struct mesh *mesh;
+    size_t count;
+    uint64_t version;
+    bool created;
+};
+
+// Instanced draw of a batch, queued until the instance stream is committed
+struct mesh_command
+{
+    const struct mesh *mesh;
+    size_t count;
+    // Index of the first instance in the current reservation
+    size_t first;
+};
+
+// Layout read by glMultiDrawElementsIndirect
+struct draw_elements_command
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// Vertices and indices written straight into their streams, drawn when
+// the batch ends or a segment fills up
+struct stream_batch
+{
+    struct stream_buffer vertices;
+    struct stream_buffer indices;
+    size_t vertex_size;
+    uint8_t *vertex_data;
+    GLuint *index_data;
+    size_t vertex_count;
+    size_t index_count;
+    size_t vertex_capacity;
+    size_t index_capacity;
+};
 
 struct vert_ui
 {
@@ -45,32 +91,62 @@ struct vert_untextured
 struct camera camera;
 
 struct vao mesh_vao;
+// Location of the first column of the model attribute
+GLuint model_location;
+// Without base instances the model attribute of mesh_vao is pointed at
+// the first instance of each draw instead
+bool base_instances;
+size_t models_first;
 struct ebo mesh_ebo;
 struct vbo mesh_vbo;
-struct vbo mesh_model_vbo;
+struct stream_buffer instance_stream;
 struct shader *mesh_instancing_shader;
 const struct mesh *instance_mesh;
-struct mat4 instancing_models[MAX_MESH_INSTANCES];
+// Points into the instance stream, or cached_models for cached batches
+struct mat4 *instancing_models;
 size_t instance_count;
+size_t instance_capacity;
+// Start of the batch being pushed in the current reservation
+size_t batch_first;
+struct mat4 cached_models[MAX_MESH_INSTANCES];
+size_t cached_count;
+struct mesh_command mesh_commands[MAX_MESH_COMMANDS];
+size_t mesh_command_count;
+struct stream_buffer indirect_stream;
+bool mesh_pass;
+struct instance_cache instance_caches[MAX_INSTANCE_CACHES];
+struct instance_cache *instance_cache;
+bool instance_cache_hit;
 
 struct vao ui_vao;
-struct vbo ui_vbo;
-struct ebo ui_ebo;
+struct stream_batch ui_batch;
 struct shader *ui_shader;
 struct font *font;
-struct vert_ui ui_vertices[MAX_UI_VERTICES];
-GLuint ui_indices[MAX_UI_INDICES];
-size_t ui_vert_count;
-size_t ui_index_count;
 
 struct vao untextured_vao;
-struct vbo untextured_vbo;
-struct ebo untextured_ebo;
+struct stream_batch untextured_batch;
 struct shader *untextured_shader;
-struct vert_untextured untextured_vertices[MAX_UNTEXTURED_VERTICES];
-GLuint untextured_indices[MAX_UNTEXTURED_INDICES];
-size_t untextured_vert_count;
-size_t untextured_index_count;
+
+struct render_stats stats;
+
+static const struct vert_attrib pos_attrib =
+{
+    .type = VTYPE_FLOAT3,
+    .normalized = false,
+    .divisor = 0,
+};
+static const struct vert_attrib uv_attrib =
+{
+    .type = VTYPE_FLOAT2,
+    .normalized = false,
+    .divisor = 0,
+};
+static const struct vert_attrib model_attrib =
+{
+    .type = VTYPE_FLOAT16,
+    .normalized = false,
+    .divisor = 1,
+};
 
 static void APIENTRY gl_message_callback(GLenum source, GLenum type, GLuint id,
                                   GLenum severity, GLsizei length,
@@ -79,6 +155,122 @@ static void APIENTRY gl_message_callback(GLenum source, GLenum type, GLuint id,
 
 static void on_window_size_changed(GLFWwindow *window, int width, int height);
 
+// Mesh vertices come from the shared buffers, instance models from models
+static void mesh_vao_init(struct vao *vao, struct vbo *models)
+{
+    vao_init(vao);
+    vao_set_ebo(vao, &mesh_ebo);
+    vao_add_vbo(vao, &mesh_vbo, 2, pos_attrib, uv_attrib);
+    model_location = vao->attrib_count;
+    vao_add_vbo(vao, models, 1, model_attrib);
+}
+
+// Expects the vao of the batch to be bound, so it takes the index buffer
+static void batch_init(struct stream_batch *b, size_t vertex_size,
+        size_t max_vertices, size_t max_indices)
+{
+    stream_init(&b->vertices, GL_ARRAY_BUFFER, max_vertices * vertex_size);
+    stream_init(&b->indices, GL_ELEMENT_ARRAY_BUFFER,
+            max_indices * sizeof(GLuint));
+
+    b->vertex_size = vertex_size;
+    b->vertex_data = NULL;
+    b->index_data = NULL;
+    b->vertex_count = 0;
+    b->index_count = 0;
+    b->vertex_capacity = 0;
+    b->index_capacity = 0;
+}
+
+static void batch_free(struct stream_batch *b)
+{
+    stream_free(&b->vertices);
+    stream_free(&b->indices);
+}
+
+static void batch_draw(struct stream_batch *b)
+{
+    if (b->vertex_count && b->index_count)
+    {
+        size_t vertex_offset = stream_commit(&b->vertices,
+                b->vertex_count * b->vertex_size);
+        size_t index_offset = stream_commit(&b->indices,
+                b->index_count * sizeof(GLuint));
+
+        glDrawElementsBaseVertex(GL_TRIANGLES, b->index_count,
+                GL_UNSIGNED_INT, (const GLvoid *)index_offset,
+                vertex_offset / b->vertex_size);
+        stats.draw_calls++;
+    }
+
+    b->vertex_count = 0;
+    b->index_count = 0;
+    b->vertex_capacity = 0;
+    b->index_capacity = 0;
+}
+
+// Draws what the batch has so far if the new vertices do not fit
+static void batch_reserve(struct stream_batch *b, size_t vertices,
+        size_t indices)
+{
+    if (b->vertex_count + vertices <= b->vertex_capacity &&
+            b->index_count + indices <= b->index_capacity)
+    {
+        return;
+    }
+
+    batch_draw(b);
+
+    size_t available;
+    b->vertex_data = stream_reserve(&b->vertices, vertices * b->vertex_size,
+            b->vertex_size, &available);
+    b->vertex_capacity = available / b->vertex_size;
+    b->index_data = stream_reserve(&b->indices, indices * sizeof(GLuint),
+            sizeof(GLuint), &available);
+    b->index_capacity = available / sizeof(GLuint);
+}
+
+// Meshes never change after loading, so all of them go into one pair of
+// static buffers and are drawn with their base vertex
+static void upload_meshes()
+{
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    for (enum asset_mesh handle = 0; handle < ASSET_MESH_END; handle++)
+    {
+        const struct mesh *mesh = get_mesh(handle);
+        vertex_count += mesh->vertex_count;
+        index_count += mesh->index_count;
+    }
+
+    struct vert_mesh *vertices =
+        malloc(vertex_count * sizeof(struct vert_mesh));
+    GLuint *indices = malloc(index_count * sizeof(GLuint));
+
+    size_t vertex_offset = 0;
+    size_t index_offset = 0;
+    for (enum asset_mesh handle = 0; handle < ASSET_MESH_END; handle++)
+    {
+        struct mesh *mesh = get_mesh(handle);
+        mesh->base_vertex = vertex_offset;
+        mesh->first_index = index_offset;
+
+        memcpy(vertices + vertex_offset, mesh->vertices,
+                mesh->vertex_count * sizeof(struct vert_mesh));
+        memcpy(indices + index_offset, mesh->indices,
+                mesh->index_count * sizeof(GLuint));
+        vertex_offset += mesh->vertex_count;
+        index_offset += mesh->index_count;
+    }
+
+    ebo_init(&mesh_ebo, index_count, indices, BUFFER_STATIC);
+    vbo_init(&mesh_vbo, vertex_count * sizeof(struct vert_mesh), vertices,
+            BUFFER_STATIC);
+
+    free(vertices);
+    free(indices);
+}
+
 bool render_init(GLFWwindow *window)
 {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -107,24 +299,6 @@ bool render_init(GLFWwindow *window)
     camera.cnear = CAMERA_NEAR;
     camera.cfar = CAMERA_FAR;
 
-    struct vert_attrib pos_attrib =
-    {
-        .type = VTYPE_FLOAT3,
-        .normalized = false,
-        .divisor = 0,
-    };
-    struct vert_attrib uv_attrib =
-    {
-        .type = VTYPE_FLOAT2,
-        .normalized = false,
-        .divisor = 0,
-    };
-    struct vert_attrib model_attrib =
-    {
-        .type = VTYPE_FLOAT16,
-        .normalized = false,
-        .divisor = 1,
-    };
     struct vert_attrib color_attrib =
     {
         .type = VTYPE_UBYTE4,
@@ -139,21 +313,34 @@ bool render_init(GLFWwindow *window)
     };
 
     // Mesh rendering setup
-    vao_init(&mesh_vao);
-    vao_bind(&mesh_vao);
-
-    ebo_init(&mesh_ebo, MAX_MESH_INDICES, NULL, BUFFER_DYNAMIC);
-    vbo_init(&mesh_vbo, MAX_MESH_VERTICES * sizeof(struct vert_mesh),
-            NULL, BUFFER_DYNAMIC);
-    vbo_init(&mesh_model_vbo, MAX_MESH_INSTANCES * sizeof(struct mat4),
-            NULL, BUFFER_DYNAMIC);
+    upload_meshes();
+    stream_init(&instance_stream, GL_ARRAY_BUFFER,
+            MAX_MESH_INSTANCES * sizeof(struct mat4));
+    mesh_vao_init(&mesh_vao, &instance_stream.vbo);
+    base_instances = GLEW_ARB_base_instance;
+    models_first = 0;
+    if (!base_instances)
+    {
+        log_warn("No base instance support, instanced draws rebind models");
+    }
 
-    vao_set_ebo(&mesh_vao, &mesh_ebo);
-    vao_add_vbo(&mesh_vao, &mesh_vbo, 2, pos_attrib, uv_attrib);
-    vao_add_vbo(&mesh_vao, &mesh_model_vbo, 1, model_attrib);
+    stream_init(&indirect_stream, GL_DRAW_INDIRECT_BUFFER,
+            MAX_MESH_COMMANDS * sizeof(struct draw_elements_command));
 
     instance_mesh = NULL;
+    instancing_models = NULL;
     instance_count = 0;
+    instance_capacity = 0;
+    batch_first = 0;
+    cached_count = 0;
+    mesh_command_count = 0;
+    mesh_pass = false;
+    instance_cache = NULL;
+    instance_cache_hit = false;
+    for (size_t i = 0; i < MAX_INSTANCE_CACHES; i++)
+    {
+        instance_caches[i].created = false;
+    }
 
     mesh_instancing_shader = get_shader(ASSET_SHADER_MESH);
     glUseProgram(mesh_instancing_shader->id);
@@ -162,12 +349,12 @@ bool render_init(GLFWwindow *window)
     // UI rendering setup
     vao_init(&ui_vao);
     vao_bind(&ui_vao);
-    vbo_init(&ui_vbo, MAX_UI_VERTICES * sizeof(struct vert_ui), NULL,
-            BUFFER_DYNAMIC);
-    ebo_init(&ui_ebo, MAX_UI_INDICES, NULL, BUFFER_DYNAMIC);
+    batch_init(&ui_batch, sizeof(struct vert_ui), MAX_UI_VERTICES,
+            MAX_UI_INDICES);
 
-    vao_set_ebo(&ui_vao, &ui_ebo);
-    vao_add_vbo(&ui_vao, &ui_vbo, 2, ui_attrib, color_attrib);
+    vao_set_ebo(&ui_vao, &ui_batch.indices.ebo);
+    vao_add_vbo(&ui_vao, &ui_batch.vertices.vbo, 2, ui_attrib,
+            color_attrib);
 
     ui_shader = get_shader(ASSET_SHADER_UI);
     glUseProgram(ui_shader->id);
@@ -181,11 +368,11 @@ bool render_init(GLFWwindow *window)
     // Untextured rendering setup
     vao_init(&untextured_vao);
     vao_bind(&untextured_vao);
-    vbo_init(&untextured_vbo, MAX_UNTEXTURED_VERTICES, NULL, BUFFER_DYNAMIC);
-    ebo_init(&untextured_ebo, MAX_UNTEXTURED_INDICES, NULL, BUFFER_DYNAMIC);
+    batch_init(&untextured_batch, sizeof(struct vert_untextured),
+            MAX_UNTEXTURED_VERTICES, MAX_UNTEXTURED_INDICES);
 
-    vao_set_ebo(&untextured_vao, &untextured_ebo);
-    vao_add_vbo(&untextured_vao, &untextured_vbo, 2,
+    vao_set_ebo(&untextured_vao, &untextured_batch.indices.ebo);
+    vao_add_vbo(&untextured_vao, &untextured_batch.vertices.vbo, 2,
             pos_attrib, color_attrib);
 
     untextured_shader = get_shader(ASSET_SHADER_UNTEXTURED);
@@ -197,65 +384,345 @@ void render_shutdown()
 {
     ebo_free(&mesh_ebo);
     vbo_free(&mesh_vbo);
-    vbo_free(&mesh_model_vbo);
+    stream_free(&instance_stream);
+    stream_free(&indirect_stream);
     vao_free(&mesh_vao);
 
-    ebo_free(&ui_ebo);
-    vbo_free(&ui_vbo);
+    for (size_t i = 0; i < MAX_INSTANCE_CACHES; i++)
+    {
+        if (instance_caches[i].created)
+        {
+            vbo_free(&instance_caches[i].models);
+            vao_free(&instance_caches[i].vao);
+        }
+    }
+
+    batch_free(&ui_batch);
     vao_free(&ui_vao);
 
-    ebo_free(&untextured_ebo);
-    vbo_free(&untextured_vbo);
+    batch_free(&untextured_batch);
     vao_free(&untextured_vao);
 }
 
+static void bind_mesh_state()
+{
+    vao_bind(&mesh_vao);
+
+    glUseProgram(mesh_instancing_shader->id);
+    struct mat4 view = camera_view(&camera);
+    struct mat4 proj = camera_projection(&camera);
+    shader_set_mat4(mesh_instancing_shader, "u_view", &view);
+    shader_set_mat4(mesh_instancing_shader, "u_projection", &proj);
+    stats.state_changes += 4;
+}
+
+static void bind_mesh_texture(const struct texture *texture)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture->id);
+    stats.state_changes++;
+}
+
+static void draw_mesh_instances(const struct mesh *mesh, size_t count,
+        size_t base_instance)
+{
+    if (base_instance)
+    {
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                mesh->index_count, GL_UNSIGNED_INT,
+                (const GLvoid *)(mesh->first_index * sizeof(GLuint)),
+                count, mesh->base_vertex, base_instance);
+    }
+    else
+    {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+                mesh->index_count, GL_UNSIGNED_INT,
+                (const GLvoid *)(mesh->first_index * sizeof(GLuint)),
+                count, mesh->base_vertex);
+    }
+    stats.draw_calls++;
+}
+
+// Instances starting at first in the instance stream, mesh_vao is bound
+static void draw_streamed_instances(const struct mesh *mesh, size_t count,
+        size_t first)
+{
+    if (base_instances)
+    {
+        draw_mesh_instances(mesh, count, first);
+        return;
+    }
+
+    if (first != models_first)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instance_stream.vbo.id);
+        for (GLuint i = 0; i < 4; i++)
+        {
+            glVertexAttribPointer(model_location + i, 4, GL_FLOAT, GL_FALSE,
+                    sizeof(struct mat4), (const GLvoid *)(first *
+                        sizeof(struct mat4) + i * 4 * sizeof(GLfloat)));
+        }
+        models_first = first;
+        stats.state_changes++;
+    }
+    draw_mesh_instances(mesh, count, 0);
+}
+
+// In a mesh pass the queued commands are drawn with one submission per
+// texture, otherwise each was drawn as soon as its batch ended
+static void draw_mesh_commands(size_t base_instance)
+{
+    bool drawn[MAX_MESH_COMMANDS] = { false };
+    size_t group[MAX_MESH_COMMANDS];
+    bool indirect = mesh_pass && base_instances
+        && GLEW_ARB_multi_draw_indirect;
+
+    if (indirect)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_stream.vbo.id);
+        stats.state_changes++;
+    }
+
+    for (size_t i = 0; i < mesh_command_count; i++)
+    {
+        if (drawn[i])
+        {
+            continue;
+        }
+
+        const struct texture *texture = mesh_commands[i].mesh->texture;
+        size_t group_count = 0;
+        for (size_t j = i; j < mesh_command_count; j++)
+        {
+            if (mesh_commands[j].mesh->texture == texture)
+            {
+                group[group_count++] = j;
+                drawn[j] = true;
+            }
+        }
+
+        if (mesh_pass)
+        {
+            bind_mesh_texture(texture);
+        }
+
+        if (!indirect)
+        {
+            for (size_t j = 0; j < group_count; j++)
+            {
+                const struct mesh_command *cmd = mesh_commands + group[j];
+                draw_streamed_instances(cmd->mesh, cmd->count,
+                        base_instance + cmd->first);
+            }
+            continue;
+        }
+
+        size_t available;
+        struct draw_elements_command *draws = stream_reserve(&indirect_stream,
+                group_count * sizeof(struct draw_elements_command),
+                sizeof(struct draw_elements_command), &available);
+        for (size_t j = 0; j < group_count; j++)
+        {
+            const struct mesh_command *cmd = mesh_commands + group[j];
+            draws[j].count = cmd->mesh->index_count;
+            draws[j].instance_count = cmd->count;
+            draws[j].first_index = cmd->mesh->first_index;
+            draws[j].base_vertex = cmd->mesh->base_vertex;
+            draws[j].base_instance = base_instance + cmd->first;
+        }
+
+        size_t offset = stream_commit(&indirect_stream,
+                group_count * sizeof(struct draw_elements_command));
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const GLvoid *)offset, group_count, 0);
+        stats.draw_calls++;
+    }
+}
+
+// The base instance points each command at its range of the commit
+static void flush_mesh_commands()
+{
+    if (mesh_command_count)
+    {
+        size_t offset = stream_commit(&instance_stream,
+                instance_count * sizeof(struct mat4));
+        draw_mesh_commands(offset / sizeof(struct mat4));
+    }
+
+    mesh_command_count = 0;
+    instance_count = 0;
+    instance_capacity = 0;
+    batch_first = 0;
+}
+
+// Outside of a mesh pass the batch is drawn right away
+static void queue_mesh_batch()
+{
+    if (instance_count > batch_first)
+    {
+        struct mesh_command *cmd = mesh_commands + mesh_command_count++;
+        cmd->mesh = instance_mesh;
+        cmd->count = instance_count - batch_first;
+        cmd->first = batch_first;
+        batch_first = instance_count;
+    }
+
+    if (!mesh_pass || mesh_command_count == MAX_MESH_COMMANDS)
+    {
+        flush_mesh_commands();
+    }
+}
+
+void render_mesh_pass_begin()
+{
+    assert(!mesh_pass);
+    assert(!instance_mesh);
+
+    mesh_pass = true;
+    bind_mesh_state();
+}
+
+void render_mesh_pass_end()
+{
+    assert(mesh_pass);
+    assert(!instance_mesh);
+
+    flush_mesh_commands();
+    mesh_pass = false;
+}
+
 void render_mesh_instancing_begin(const struct mesh *mesh)
 {
-    assert(!instance_count);
     assert(!instance_mesh);
+    assert(instance_count == batch_first);
     assert(mesh->texture);
 
     instance_mesh = mesh;
 
-    vao_bind(&mesh_vao);
+    if (!mesh_pass)
+    {
+        bind_mesh_state();
+        bind_mesh_texture(mesh->texture);
+    }
+}
+
+bool render_mesh_instancing_begin_cached(const struct mesh *mesh,
+        uint32_t key, uint64_t version)
+{
+    assert(key < MAX_INSTANCE_CACHES);
 
-    ebo_set_data(&mesh_ebo, mesh->index_count, mesh->indices);
-    vbo_set_data(&mesh_vbo, mesh->vertex_count * sizeof(struct vert_mesh),
-            mesh->vertices);
+    render_mesh_instancing_begin(mesh);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, mesh->texture->id);
+    struct instance_cache *cache = instance_caches + key;
+    if (!cache->created)
+    {
+        vbo_init(&cache->models, 0, NULL, BUFFER_STATIC);
+        mesh_vao_init(&cache->vao, &cache->models);
+        cache->created = true;
+        cache->mesh = NULL;
+    }
 
-    glUseProgram(mesh_instancing_shader->id);
-    struct mat4 view = camera_view(&camera);
-    struct mat4 proj = camera_projection(&camera);
-    shader_set_mat4(mesh_instancing_shader, "u_view", &view);
-    shader_set_mat4(mesh_instancing_shader, "u_projection", &proj);
+    // Drawn on its own when the batch ends, with its own models
+    vao_bind(&cache->vao);
+    stats.state_changes++;
+    if (mesh_pass)
+    {
+        bind_mesh_texture(mesh->texture);
+    }
+
+    instance_cache = cache;
+    instance_cache_hit = cache->mesh == mesh && cache->version == version;
+    cache->mesh = mesh;
+    cache->version = version;
+
+    return instance_cache_hit;
 }
 
 void render_push_mesh_transform(const struct transform *transform)
+{
+    struct mat4 model = transform_matrix(transform);
+    render_push_mesh_matrix(&model);
+}
+
+// Draws the queued instances if count more do not fit in the stream
+static struct mat4 *reserve_instances(size_t count)
 {
     assert(instance_mesh);
-    assert(instance_count < MAX_MESH_INSTANCES);
+    assert(!instance_cache_hit);
+    assert(count <= MAX_MESH_INSTANCES);
+
+    if (instance_cache)
+    {
+        assert(cached_count + count <= MAX_MESH_INSTANCES);
+        struct mat4 *models = cached_models + cached_count;
+        cached_count += count;
+        return models;
+    }
+
+    // Queued commands read the current reservation, so they are drawn
+    // before the stream can move on to another segment
+    if (instance_count + count > instance_capacity)
+    {
+        queue_mesh_batch();
+        flush_mesh_commands();
+
+        size_t available;
+        instancing_models = stream_reserve(&instance_stream,
+                count * sizeof(struct mat4), sizeof(struct mat4),
+                &available);
+        instance_capacity = available / sizeof(struct mat4);
+    }
+
+    struct mat4 *models = instancing_models + instance_count;
+    instance_count += count;
+    return models;
+}
 
-    instancing_models[instance_count] = transform_matrix(transform);
-    instance_count++;
+void render_push_mesh_matrix(const struct mat4 *model)
+{
+    *reserve_instances(1) = *model;
+}
+
+struct mat4 *render_push_mesh_instances(size_t count)
+{
+    return reserve_instances(count);
 }
 
 void render_mesh_instancing_end()
 {
     assert(instance_mesh);
 
-    if (instance_count)
+    if (instance_cache)
     {
-        vbo_set_data(&mesh_model_vbo, instance_count * sizeof(struct mat4),
-                instancing_models);
-        glDrawElementsInstanced(GL_TRIANGLES, instance_mesh->index_count,
-                GL_UNSIGNED_INT, 0, instance_count);
+        if (!instance_cache_hit)
+        {
+            vbo_set_storage(&instance_cache->models,
+                    cached_count * sizeof(struct mat4), cached_models,
+                    BUFFER_STATIC);
+            instance_cache->count = cached_count;
+        }
+
+        if (instance_cache->count)
+        {
+            draw_mesh_instances(instance_mesh, instance_cache->count, 0);
+            stats.cached_draw_calls++;
+        }
+
+        if (mesh_pass)
+        {
+            vao_bind(&mesh_vao);
+            stats.state_changes++;
+        }
+    }
+    else
+    {
+        queue_mesh_batch();
     }
 
-    instance_count = 0;
+    cached_count = 0;
     instance_mesh = NULL;
+    instance_cache = NULL;
+    instance_cache_hit = false;
 }
 
 void render_ui_begin()
@@ -265,21 +732,12 @@ void render_ui_begin()
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, font->bitmap.id);
+    stats.state_changes += 3;
 }
 
 void render_ui_end()
 {
-    if (ui_vert_count && ui_index_count)
-    {
-        vbo_set_data(&ui_vbo, ui_vert_count * sizeof(struct vert_ui),
-                ui_vertices);
-        ebo_set_data(&ui_ebo, ui_index_count, ui_indices);
-        glDrawElements(GL_TRIANGLES, ui_index_count,
-                GL_UNSIGNED_INT, (void*)NULL);
-    }
-
-    ui_vert_count = 0;
-    ui_index_count = 0;
+    batch_draw(&ui_batch);
 }
 
 void render_push_ui_text(const char *str, struct vec2 pos,
@@ -288,8 +746,6 @@ void render_push_ui_text(const char *str, struct vec2 pos,
     float curx = pos.x;
     float cury = pos.y;
 
-    struct vert_ui *vert = ui_vertices + ui_vert_count;
-
     uint8_t c;
     while ((c = *str))
     {
@@ -304,8 +760,9 @@ void render_push_ui_text(const char *str, struct vec2 pos,
         }
 
         assert(c >= font->start_id && c < font->start_id + font->num_char);
-        assert(ui_vert_count + 4 <= MAX_UI_VERTICES);
-        assert(ui_index_count + 6 <= MAX_UI_INDICES);
+        batch_reserve(&ui_batch, 4, 6);
+        struct vert_ui *vert = (struct vert_ui *)ui_batch.vertex_data +
+            ui_batch.vertex_count;
 
         struct fchar *fchar = font->chars + c - font->start_id;
         float x0 = curx + fchar->xoff * size;
@@ -346,16 +803,17 @@ void render_push_ui_text(const char *str, struct vec2 pos,
         vert->col = col;
         vert++;
 
-        GLuint *index = ui_indices + ui_index_count;
-        index[0] = ui_vert_count;
-        index[1] = ui_vert_count + 1;
-        index[2] = ui_vert_count + 2;
-        index[3] = ui_vert_count;
-        index[4] = ui_vert_count + 2;
-        index[5] = ui_vert_count + 3;
+        GLuint *index = ui_batch.index_data + ui_batch.index_count;
+        GLuint first = ui_batch.vertex_count;
+        index[0] = first;
+        index[1] = first + 1;
+        index[2] = first + 2;
+        index[3] = first;
+        index[4] = first + 2;
+        index[5] = first + 3;
 
-        ui_vert_count += 4;
-        ui_index_count += 6;
+        ui_batch.vertex_count += 4;
+        ui_batch.index_count += 6;
 
         curx += fchar->adv * size;
         str++;
@@ -370,34 +828,21 @@ void render_untextured_begin()
     struct mat4 proj = camera_projection(&camera);
     shader_set_mat4(untextured_shader, "u_view", &view);
     shader_set_mat4(untextured_shader, "u_projection", &proj);
+    stats.state_changes += 4;
 }
 
 void render_untextured_end()
 {
-    if (untextured_vert_count && untextured_index_count)
-    {
-        vbo_set_data(&untextured_vbo,
-                untextured_vert_count * sizeof(struct vert_untextured),
-                untextured_vertices);
-
-        ebo_set_data(&untextured_ebo, untextured_index_count,
-                untextured_indices);
-
-        glDrawElements(GL_TRIANGLES, untextured_index_count,
-                GL_UNSIGNED_INT, (void*)NULL);
-    }
-
-    untextured_vert_count = 0;
-    untextured_index_count = 0;
+    batch_draw(&untextured_batch);
 }
 
 void render_push_untextured_quad(struct vec3 a, struct vec3 b, struct vec3 c,
         struct vec3 d, struct color col)
 {
-    assert(untextured_vert_count + 4 <= MAX_UNTEXTURED_VERTICES);
-    assert(untextured_index_count + 6 <= MAX_UNTEXTURED_INDICES);
+    batch_reserve(&untextured_batch, 4, 6);
 
-    struct vert_untextured *vert = untextured_vertices + untextured_vert_count;
+    struct vert_untextured *vert = (struct vert_untextured *)
+        untextured_batch.vertex_data + untextured_batch.vertex_count;
 
     vert->pos = a;
     vert->col = col;
@@ -415,17 +860,19 @@ void render_push_untextured_quad(struct vec3 a, struct vec3 b, struct vec3 c,
     vert->col = col;
     vert++;
 
-    GLuint *index = untextured_indices + untextured_index_count;
+    GLuint *index = untextured_batch.index_data +
+        untextured_batch.index_count;
+    GLuint first = untextured_batch.vertex_count;
 
-    index[0] = untextured_vert_count;
-    index[1] = untextured_vert_count + 1;
-    index[2] = untextured_vert_count + 2;
-    index[3] = untextured_vert_count;
-    index[4] = untextured_vert_count + 2;
-    index[5] = untextured_vert_count + 3;
+    index[0] = first;
+    index[1] = first + 1;
+    index[2] = first + 2;
+    index[3] = first;
+    index[4] = first + 2;
+    index[5] = first + 3;
 
-    untextured_vert_count += 4;
-    untextured_index_count += 6;
+    untextured_batch.vertex_count += 4;
+    untextured_batch.index_count += 6;
 }
 
 void render_push_untextured_volume(struct vec3 p0, struct vec3 p1,
@@ -524,6 +971,18 @@ struct camera *get_camera()
     return &camera;
 }
 
+struct render_stats render_get_stats()
+{
+    return stats;
+}
+
+void render_reset_stats()
+{
+    stats.draw_calls = 0;
+    stats.cached_draw_calls = 0;
+    stats.state_changes = 0;
+}
+
 void on_window_size_changed(GLFWwindow *window, int width, int height)
 {
     // Preserve aspect ratio
@@ -12,13 +12,42 @@
 #define UI_WIDTH 1920.0f
 #define UI_HEIGHT 1080.0f
 
+// Most instances one segment of the instance stream holds, so the most
+// render_push_mesh_instances reserves at once and a cached batch keeps
+#define MAX_MESH_INSTANCES 30000
+
+struct render_stats
+{
+    size_t draw_calls;
+    // Of draw_calls, those of cached batches. These keep their own models
+    // buffer, so a mesh pass draws them on their own rather than in its
+    // per-texture submissions
+    size_t cached_draw_calls;
+    // Vertex array, program, texture, uniform and buffer bindings
+    size_t state_changes;
+};
+
 bool render_init(GLFWwindow *window);
 void render_shutdown();
 
 void render_skybox();
 
+// Batches between these are queued and drawn together at the end, with one
+// multi draw per texture when indirect drawing is available
+void render_mesh_pass_begin();
+void render_mesh_pass_end();
+
 void render_mesh_instancing_begin(const struct mesh *mesh);
+// Keeps the instances of the batch in a buffer of their own under key.
+// Returns true if the ones pushed for this version are still there, then
+// nothing is pushed before render_mesh_instancing_end.
+bool render_mesh_instancing_begin_cached(const struct mesh *mesh,
+        uint32_t key, uint64_t version);
 void render_push_mesh_transform(const struct transform *transform);
+void render_push_mesh_matrix(const struct mat4 *model);
+// Reserves count instances and returns their models for the caller to fill
+// in before render_mesh_instancing_end
+struct mat4 *render_push_mesh_instances(size_t count);
 void render_mesh_instancing_end();
 
 void render_ui_begin();
@@ -42,3 +71,7 @@ void render_push_untextured_volume_outline(struct vec3 p0, struct vec3 p1,
         struct vec3 p6, struct vec3 p7, float thickness, struct color col);
 
 struct camera *get_camera();
+
+// Counted since the last reset
+struct render_stats render_get_stats();
+void render_reset_stats();
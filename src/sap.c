@@ -0,0 +1,538 @@
+#include "sap.h"
+#include <assert.h>
+#include <string.h>
+
+#define SAP_START_CAPACITY  256
+
+// Fraction of new boxes at which the lists are sorted from scratch
+// instead of inserting the new endpoints one at a time
+#define SAP_REBUILD_RATIO   4
+
+static float bbox_min(struct bbox b, size_t axis)
+{
+    switch (axis)
+    {
+        case 0:
+            return b.x1;
+        case 1:
+            return b.y1;
+        default:
+            return b.z1;
+    }
+}
+
+static float bbox_max(struct bbox b, size_t axis)
+{
+    switch (axis)
+    {
+        case 0:
+            return b.x2;
+        case 1:
+            return b.y2;
+        default:
+            return b.z2;
+    }
+}
+
+static bool is_max(struct sap_endpoint e)
+{
+    return e.data & 1;
+}
+
+static int32_t endpoint_box(struct sap_endpoint e)
+{
+    return e.data >> 1;
+}
+
+// Min endpoints sort before max endpoints with the same value, so that
+// touching boxes count as overlapping like in bbox_overlapping
+static bool endpoint_less(struct sap_endpoint a, struct sap_endpoint b)
+{
+    return a.value < b.value ||
+        (a.value == b.value && !is_max(a) && is_max(b));
+}
+
+static int endpoint_cmp(const void *a, const void *b)
+{
+    const struct sap_endpoint *ea = a;
+    const struct sap_endpoint *eb = b;
+
+    if (endpoint_less(*ea, *eb))
+    {
+        return -1;
+    }
+    if (endpoint_less(*eb, *ea))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+static void *grow(void *arr, size_t *capacity, size_t count, size_t size)
+{
+    if (count < *capacity)
+    {
+        return arr;
+    }
+
+    while (*capacity <= count)
+    {
+        *capacity *= 2;
+    }
+
+    return realloc(arr, *capacity * size);
+}
+
+static uint32_t pair_hash(int32_t a, int32_t b)
+{
+    uint64_t key = ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+
+    return key;
+}
+
+static size_t pair_home(const struct sap *s, const struct sap_pair *p)
+{
+    return pair_hash(p->a, p->b) & (s->table_capacity - 1);
+}
+
+// Returns the table slot holding the pair, or the empty slot where it
+// would be inserted
+static size_t pair_find(const struct sap *s, int32_t a, int32_t b)
+{
+    size_t mask = s->table_capacity - 1;
+    size_t slot = pair_hash(a, b) & mask;
+
+    while (s->pair_table[slot])
+    {
+        const struct sap_pair *p = s->pairs + s->pair_table[slot] - 1;
+        if (p->a == a && p->b == b)
+        {
+            break;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static void rehash(struct sap *s, size_t capacity)
+{
+    free(s->pair_table);
+    s->table_capacity = capacity;
+    s->pair_table = calloc(capacity, sizeof(uint32_t));
+
+    for (size_t i = 0; i < s->pair_count; i++)
+    {
+        const struct sap_pair *p = s->pairs + i;
+        s->pair_table[pair_find(s, p->a, p->b)] = i + 1;
+    }
+}
+
+static bool pair_wanted(const struct sap *s, int32_t a, int32_t b)
+{
+    return (s->boxes[a].mask & s->boxes[b].category) ||
+        (s->boxes[b].mask & s->boxes[a].category);
+}
+
+static void pair_add(struct sap *s, int32_t a, int32_t b)
+{
+    if (a > b)
+    {
+        int32_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    size_t slot = pair_find(s, a, b);
+    if (s->pair_table[slot])
+    {
+        return;
+    }
+
+    if ((s->pair_count + 1) * 2 > s->table_capacity)
+    {
+        rehash(s, s->table_capacity * 2);
+        slot = pair_find(s, a, b);
+    }
+
+    struct sap_pair pair;
+    pair.a = a;
+    pair.b = b;
+    pair.id_a = s->boxes[a].id;
+    pair.id_b = s->boxes[b].id;
+
+    s->pairs = grow(s->pairs, &s->pair_capacity, s->pair_count,
+            sizeof(struct sap_pair));
+    s->pairs[s->pair_count++] = pair;
+    s->pair_table[slot] = s->pair_count;
+}
+
+static void pair_remove(struct sap *s, int32_t a, int32_t b)
+{
+    if (a > b)
+    {
+        int32_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    size_t slot = pair_find(s, a, b);
+    if (!s->pair_table[slot])
+    {
+        return;
+    }
+
+    uint32_t index = s->pair_table[slot] - 1;
+
+    // Backward shift deletion keeps probe sequences intact
+    size_t mask = s->table_capacity - 1;
+    size_t hole = slot;
+    size_t next = slot;
+    while (true)
+    {
+        next = (next + 1) & mask;
+        if (!s->pair_table[next])
+        {
+            break;
+        }
+
+        size_t home = pair_home(s, s->pairs + s->pair_table[next] - 1);
+        bool in_between = hole <= next ?
+            (hole < home && home <= next) : (hole < home || home <= next);
+        if (in_between)
+        {
+            continue;
+        }
+
+        s->pair_table[hole] = s->pair_table[next];
+        hole = next;
+    }
+    s->pair_table[hole] = 0;
+
+    s->pair_count--;
+    if (index != s->pair_count)
+    {
+        struct sap_pair *moved = s->pairs + s->pair_count;
+        s->pair_table[pair_find(s, moved->a, moved->b)] = index + 1;
+        s->pairs[index] = *moved;
+    }
+}
+
+static void insertion_sort(struct sap *s, size_t axis)
+{
+    struct sap_endpoint *ep = s->axes[axis];
+
+    for (size_t i = 1; i < s->endpoint_count; i++)
+    {
+        struct sap_endpoint e = ep[i];
+        size_t j = i;
+
+        while (j > 0 && endpoint_less(e, ep[j - 1]))
+        {
+            struct sap_endpoint p = ep[j - 1];
+            int32_t a = endpoint_box(e);
+            int32_t b = endpoint_box(p);
+
+            if (!is_max(e) && is_max(p))
+            {
+                if (pair_wanted(s, a, b) &&
+                        bbox_overlapping(s->boxes[a].bbox, s->boxes[b].bbox))
+                {
+                    pair_add(s, a, b);
+                }
+            }
+            else if (is_max(e) && !is_max(p) && pair_wanted(s, a, b))
+            {
+                pair_remove(s, a, b);
+            }
+
+            ep[j] = p;
+            j--;
+        }
+
+        ep[j] = e;
+    }
+}
+
+static void rebuild(struct sap *s)
+{
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        qsort(s->axes[axis], s->endpoint_count, sizeof(struct sap_endpoint),
+                endpoint_cmp);
+    }
+
+    size_t old_count = s->pair_count;
+    bool *keep = calloc(old_count + 1, sizeof(bool));
+    int32_t *active = malloc((s->box_count + 1) * sizeof(int32_t));
+    size_t *active_pos = malloc((s->box_count + 1) * sizeof(size_t));
+    size_t active_count = 0;
+
+    // Sweep along the first axis, testing each box against the boxes
+    // whose interval is still open
+    const struct sap_endpoint *ep = s->axes[0];
+    for (size_t i = 0; i < s->endpoint_count; i++)
+    {
+        int32_t box = endpoint_box(ep[i]);
+        if (is_max(ep[i]))
+        {
+            size_t pos = active_pos[box];
+            active[pos] = active[--active_count];
+            active_pos[active[pos]] = pos;
+            continue;
+        }
+
+        for (size_t k = 0; k < active_count; k++)
+        {
+            int32_t other = active[k];
+            if (!pair_wanted(s, box, other) ||
+                    !bbox_overlapping(s->boxes[box].bbox, s->boxes[other].bbox))
+            {
+                continue;
+            }
+
+            int32_t a = box < other ? box : other;
+            int32_t b = box < other ? other : box;
+            size_t slot = pair_find(s, a, b);
+            if (s->pair_table[slot] && s->pair_table[slot] <= old_count)
+            {
+                keep[s->pair_table[slot] - 1] = true;
+            }
+            else
+            {
+                pair_add(s, a, b);
+            }
+        }
+
+        active_pos[box] = active_count;
+        active[active_count++] = box;
+    }
+
+    // Iterating backwards means that pairs moved by the swap removal
+    // have already been visited
+    for (size_t i = s->pair_count; i-- > 0;)
+    {
+        if (i < old_count && !keep[i])
+        {
+            pair_remove(s, s->pairs[i].a, s->pairs[i].b);
+        }
+    }
+
+    free(keep);
+    free(active);
+    free(active_pos);
+}
+
+void sap_init(struct sap *s)
+{
+    s->endpoint_capacity = SAP_START_CAPACITY;
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        s->axes[axis] = malloc(s->endpoint_capacity *
+                sizeof(struct sap_endpoint));
+    }
+
+    s->box_capacity = SAP_START_CAPACITY;
+    s->boxes = malloc(s->box_capacity * sizeof(struct sap_box));
+    s->free_boxes = malloc(s->box_capacity * sizeof(int32_t));
+    s->added = malloc(s->box_capacity * sizeof(int32_t));
+    s->removed = malloc(s->box_capacity * sizeof(int32_t));
+
+    s->pair_capacity = SAP_START_CAPACITY;
+    s->pairs = malloc(s->pair_capacity * sizeof(struct sap_pair));
+    s->table_capacity = 2 * SAP_START_CAPACITY;
+    s->pair_table = calloc(s->table_capacity, sizeof(uint32_t));
+
+    sap_clear(s);
+}
+
+void sap_free(struct sap *s)
+{
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        free(s->axes[axis]);
+    }
+
+    free(s->boxes);
+    free(s->free_boxes);
+    free(s->added);
+    free(s->removed);
+    free(s->pairs);
+    free(s->pair_table);
+}
+
+void sap_clear(struct sap *s)
+{
+    s->endpoint_count = 0;
+    s->box_count = 0;
+    s->free_count = 0;
+    s->added_count = 0;
+    s->removed_count = 0;
+    s->pair_count = 0;
+
+    memset(s->pair_table, 0, s->table_capacity * sizeof(uint32_t));
+}
+
+int32_t sap_add(struct sap *s, uint32_t id, uint32_t category,
+        uint32_t mask, struct bbox box)
+{
+    int32_t proxy;
+    if (s->free_count)
+    {
+        proxy = s->free_boxes[--s->free_count];
+    }
+    else
+    {
+        if (s->box_count == s->box_capacity)
+        {
+            s->box_capacity *= 2;
+            s->boxes = realloc(s->boxes,
+                    s->box_capacity * sizeof(struct sap_box));
+            s->free_boxes = realloc(s->free_boxes,
+                    s->box_capacity * sizeof(int32_t));
+            s->added = realloc(s->added, s->box_capacity * sizeof(int32_t));
+            s->removed = realloc(s->removed,
+                    s->box_capacity * sizeof(int32_t));
+        }
+
+        proxy = s->box_count++;
+    }
+
+    struct sap_box *b = s->boxes + proxy;
+    b->bbox = box;
+    b->id = id;
+    b->category = category;
+    b->mask = mask;
+    b->removed = false;
+
+    // Endpoints are inserted on the next update
+    s->added[s->added_count++] = proxy;
+
+    return proxy;
+}
+
+void sap_remove(struct sap *s, int32_t proxy)
+{
+    assert(!s->boxes[proxy].removed);
+
+    s->boxes[proxy].removed = true;
+    s->removed[s->removed_count++] = proxy;
+}
+
+void sap_move(struct sap *s, int32_t proxy, struct bbox box)
+{
+    s->boxes[proxy].bbox = box;
+}
+
+void sap_update(struct sap *s)
+{
+    if (s->removed_count)
+    {
+        for (size_t axis = 0; axis < 3; axis++)
+        {
+            struct sap_endpoint *ep = s->axes[axis];
+            size_t count = 0;
+            for (size_t i = 0; i < s->endpoint_count; i++)
+            {
+                if (!s->boxes[endpoint_box(ep[i])].removed)
+                {
+                    ep[count++] = ep[i];
+                }
+            }
+
+            if (axis == 2)
+            {
+                s->endpoint_count = count;
+            }
+        }
+
+        for (size_t i = s->pair_count; i-- > 0;)
+        {
+            const struct sap_pair *p = s->pairs + i;
+            if (s->boxes[p->a].removed || s->boxes[p->b].removed)
+            {
+                pair_remove(s, p->a, p->b);
+            }
+        }
+
+        // Proxies are only reused after their pairs have been removed
+        for (size_t i = 0; i < s->removed_count; i++)
+        {
+            s->free_boxes[s->free_count++] = s->removed[i];
+        }
+
+        s->removed_count = 0;
+    }
+
+    bool full_rebuild = false;
+    if (s->added_count)
+    {
+        size_t live_endpoints = s->endpoint_count;
+        full_rebuild = s->added_count * 2 * SAP_REBUILD_RATIO >
+            live_endpoints;
+
+        for (size_t i = 0; i < s->added_count; i++)
+        {
+            int32_t proxy = s->added[i];
+            if (s->boxes[proxy].removed)
+            {
+                continue;
+            }
+
+            size_t needed = s->endpoint_count + 2;
+            if (needed > s->endpoint_capacity)
+            {
+                while (s->endpoint_capacity < needed)
+                {
+                    s->endpoint_capacity *= 2;
+                }
+
+                for (size_t axis = 0; axis < 3; axis++)
+                {
+                    s->axes[axis] = realloc(s->axes[axis],
+                            s->endpoint_capacity *
+                            sizeof(struct sap_endpoint));
+                }
+            }
+
+            for (size_t axis = 0; axis < 3; axis++)
+            {
+                struct sap_endpoint *ep = s->axes[axis] + s->endpoint_count;
+                ep[0].data = proxy << 1;
+                ep[1].data = (proxy << 1) | 1;
+            }
+
+            s->endpoint_count += 2;
+        }
+
+        s->added_count = 0;
+    }
+
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+        struct sap_endpoint *ep = s->axes[axis];
+        for (size_t i = 0; i < s->endpoint_count; i++)
+        {
+            struct bbox b = s->boxes[endpoint_box(ep[i])].bbox;
+            ep[i].value = is_max(ep[i]) ? bbox_max(b, axis) :
+                bbox_min(b, axis);
+        }
+    }
+
+    if (full_rebuild)
+    {
+        rebuild(s);
+    }
+    else
+    {
+        for (size_t axis = 0; axis < 3; axis++)
+        {
+            insertion_sort(s, axis);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include "collide.h"
+
+#define SAP_NULL_PROXY -1
+
+struct sap_endpoint
+{
+    float value;
+    // Box index shifted left by one, lowest bit set for max endpoints
+    uint32_t data;
+};
+
+struct sap_box
+{
+    struct bbox bbox;
+    uint32_t id;
+    // Boxes only pair up if the mask of either has the category of the
+    // other
+    uint32_t category;
+    uint32_t mask;
+    bool removed;
+};
+
+struct sap_pair
+{
+    int32_t a, b;
+    uint32_t id_a, id_b;
+};
+
+// Sweep and prune with sorted endpoint lists that persist between
+// ticks. Insertion sort repairs the order on every update, and each swap
+// of a min and max endpoint starts or ends an overlap. The pair list is
+// only changed by those events.
+struct sap
+{
+    struct sap_endpoint *axes[3];
+    size_t endpoint_count;
+    size_t endpoint_capacity;
+
+    struct sap_box *boxes;
+    size_t box_count;
+    size_t box_capacity;
+    int32_t *free_boxes;
+    size_t free_count;
+
+    int32_t *added;
+    size_t added_count;
+    int32_t *removed;
+    size_t removed_count;
+
+    // Currently overlapping pairs with a hash index keyed on the boxes
+    struct sap_pair *pairs;
+    size_t pair_count;
+    size_t pair_capacity;
+    uint32_t *pair_table;
+    size_t table_capacity;
+};
+
+void sap_init(struct sap *s);
+void sap_free(struct sap *s);
+void sap_clear(struct sap *s);
+
+int32_t sap_add(struct sap *s, uint32_t id, uint32_t category,
+        uint32_t mask, struct bbox box);
+void sap_remove(struct sap *s, int32_t proxy);
+void sap_move(struct sap *s, int32_t proxy, struct bbox box);
+
+void sap_update(struct sap *s);
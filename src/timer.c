@@ -1,5 +1,6 @@
 #include "timer.h"
 #include <GLFW/glfw3.h>
+#include "frame.h"
 
 double time_prev;
 double time_now;
@@ -26,6 +27,8 @@ void timer_preupdate()
 
 void timer_postupdate()
 {
+    frame_alloc_reset();
+
     ticks++;
     fps_ticks_next++;
     sec_acummulator += timer_delta();
@@ -6,41 +6,154 @@ void transform_init(struct transform *t, struct vec3 pos)
 {
     t->pos = pos;
     t->scale = vec3_create(1.0f, 1.0f, 1.0f);
-    t->rot = mat4_identity();
+    t->rot = quat_identity();
 }
 
 struct vec3 transform_forward(const struct transform *t)
 {
-    return mat4_v3mul(t->rot, VEC3_FORWARD);
+    return quat_basis_z(t->rot);
 }
 
 struct vec3 transform_up(const struct transform *t)
 {
-    return mat4_v3mul(t->rot, VEC3_UP);
+    return quat_basis_y(t->rot);
 }
 
 struct vec3 transform_right(const struct transform *t)
 {
-    return mat4_v3mul(t->rot, VEC3_RIGHT);
+    return quat_basis_x(t->rot);
 }
 
+// Same as translate * rot * scale, written out from the basis vectors
 struct mat4 transform_matrix(const struct transform *t)
 {
-    return mat4_mul(mat4_mul(mat4_translate(t->pos),
-        t->rot), mat4_scale(t->scale));
+    struct vec3 x = vec3_mul(quat_basis_x(t->rot), t->scale.x);
+    struct vec3 y = vec3_mul(quat_basis_y(t->rot), t->scale.y);
+    struct vec3 z = vec3_mul(quat_basis_z(t->rot), t->scale.z);
+
+    return mat4_create(
+            x.x, y.x, z.x, t->pos.x,
+            x.y, y.y, z.y, t->pos.y,
+            x.z, y.z, z.z, t->pos.z,
+            0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+#ifdef VECTOR_SIMD
+// Four transforms at once with one in each lane, rows are transposed back
+// into the matrices at the end
+static void transform_matrices4(struct mat4 *res,
+        const struct vec3 *positions, const struct quat *rotations,
+        const struct vec3 *scales)
+{
+    __m128 x = _mm_loadu_ps(&rotations[0].x);
+    __m128 y = _mm_loadu_ps(&rotations[1].x);
+    __m128 z = _mm_loadu_ps(&rotations[2].x);
+    __m128 w = _mm_loadu_ps(&rotations[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(x, x);
+    __m128 yy = _mm_mul_ps(y, y);
+    __m128 zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y);
+    __m128 xz = _mm_mul_ps(x, z);
+    __m128 yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x);
+    __m128 wy = _mm_mul_ps(w, y);
+    __m128 wz = _mm_mul_ps(w, z);
+
+    __m128 sx = _mm_setr_ps(scales[0].x, scales[1].x, scales[2].x,
+            scales[3].x);
+    __m128 sy = _mm_setr_ps(scales[0].y, scales[1].y, scales[2].y,
+            scales[3].y);
+    __m128 sz = _mm_setr_ps(scales[0].z, scales[1].z, scales[2].z,
+            scales[3].z);
+
+    // Columns of the rotation like quat_basis_x, y and z, then scaled
+    __m128 m11 = _mm_mul_ps(_mm_sub_ps(one,
+                _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    __m128 m21 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    __m128 m31 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+
+    __m128 m12 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    __m128 m22 = _mm_mul_ps(_mm_sub_ps(one,
+                _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    __m128 m32 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+
+    __m128 m13 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    __m128 m23 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    __m128 m33 = _mm_mul_ps(_mm_sub_ps(one,
+                _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+    __m128 m14 = _mm_setr_ps(positions[0].x, positions[1].x,
+            positions[2].x, positions[3].x);
+    __m128 m24 = _mm_setr_ps(positions[0].y, positions[1].y,
+            positions[2].y, positions[3].y);
+    __m128 m34 = _mm_setr_ps(positions[0].z, positions[1].z,
+            positions[2].z, positions[3].z);
+
+    _MM_TRANSPOSE4_PS(m11, m12, m13, m14);
+    _MM_TRANSPOSE4_PS(m21, m22, m23, m24);
+    _MM_TRANSPOSE4_PS(m31, m32, m33, m34);
+
+    __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    __m128 rows[4][3] =
+    {
+        { m11, m21, m31 },
+        { m12, m22, m32 },
+        { m13, m23, m33 },
+        { m14, m24, m34 },
+    };
+
+    for (int i = 0; i < 4; i++)
+    {
+        _mm_storeu_ps(res[i].vals, rows[i][0]);
+        _mm_storeu_ps(res[i].vals + 4, rows[i][1]);
+        _mm_storeu_ps(res[i].vals + 8, rows[i][2]);
+        _mm_storeu_ps(res[i].vals + 12, last);
+    }
+}
+#endif
+
+void transform_matrices(struct mat4 *res, const struct vec3 *positions,
+        const struct quat *rotations, const struct vec3 *scales,
+        size_t count)
+{
+    size_t i = 0;
+
+#ifdef VECTOR_SIMD
+    for (; i + 4 <= count; i += 4)
+    {
+        transform_matrices4(res + i, positions + i, rotations + i,
+                scales + i);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        struct transform t = { positions[i], scales[i], rotations[i] };
+        res[i] = transform_matrix(&t);
+    }
+}
+
+// Normalized after every step so rounding errors can not build up
+void transform_local_rot(struct transform *t, struct vec3 axis, float delta)
+{
+    t->rot = quat_normalize(quat_mul(t->rot, quat_axis_angle(axis, delta)));
 }
 
 void transform_local_rotx(struct transform *t, float delta)
 {
-    t->rot = mat4_mul(t->rot, mat4_rotx(delta));
+    transform_local_rot(t, VEC3_RIGHT, delta);
 }
 
 void transform_local_roty(struct transform *t, float delta)
 {
-    t->rot = mat4_mul(t->rot, mat4_roty(delta));
+    transform_local_rot(t, VEC3_UP, delta);
 }
 
 void transform_local_rotz(struct transform *t, float delta)
 {
-    t->rot = mat4_mul(t->rot, mat4_rotz(delta));
+    transform_local_rot(t, VEC3_FORWARD, delta);
 }
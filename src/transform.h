@@ -1,11 +1,12 @@
 #pragma once
+#include <stddef.h>
 #include "vector.h"
 
 struct transform
 {
     struct vec3 pos;
     struct vec3 scale;
-    struct mat4 rot;
+    struct quat rot;
 };
 
 void transform_init(struct transform *t, struct vec3 pos);
@@ -13,6 +14,11 @@ struct vec3 transform_forward(const struct transform *t);
 struct vec3 transform_up(const struct transform *t);
 struct vec3 transform_right(const struct transform *t);
 struct mat4 transform_matrix(const struct transform *t);
+// Same matrices as transform_matrix for count transforms split into arrays
+void transform_matrices(struct mat4 *res, const struct vec3 *positions,
+        const struct quat *rotations, const struct vec3 *scales,
+        size_t count);
+void transform_local_rot(struct transform *t, struct vec3 axis, float delta);
 void transform_local_rotx(struct transform *t, float delta);
 void transform_local_roty(struct transform *t, float delta);
 void transform_local_rotz(struct transform *t, float delta);
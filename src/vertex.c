@@ -1,4 +1,5 @@
 #include "vertex.h"
+#include <assert.h>
 #include <stdarg.h>
 
 void vbo_init(struct vbo *vbo, size_t size, const void *data,
@@ -20,6 +21,13 @@ void vbo_set_data(struct vbo *vbo, size_t size, const void *data)
     glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
 }
 
+void vbo_set_storage(struct vbo *vbo, size_t size, const void *data,
+        enum buffer_usage usage)
+{
+    vbo_bind(vbo);
+    glBufferData(GL_ARRAY_BUFFER, size, data, usage);
+}
+
 void vbo_free(struct vbo *vbo)
 {
     glDeleteBuffers(1, &vbo->id);
@@ -50,6 +58,126 @@ void ebo_free(struct ebo *ebo)
     glDeleteBuffers(1, &ebo->id);
 }
 
+void stream_init(struct stream_buffer *s, GLenum target,
+        size_t segment_size)
+{
+    size_t size = segment_size * STREAM_SEGMENTS;
+
+    s->target = target;
+    s->segment_size = segment_size;
+    s->segment = 0;
+    s->offset = 0;
+    s->reserved = 0;
+    s->persistent = GLEW_ARB_buffer_storage;
+
+    for (size_t i = 0; i < STREAM_SEGMENTS; i++)
+    {
+        s->fences[i] = NULL;
+    }
+
+    glGenBuffers(1, &s->vbo.id);
+    glBindBuffer(target, s->vbo.id);
+
+    if (s->persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+            GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, size, NULL, flags);
+        s->memory = glMapBufferRange(target, 0, size, flags);
+    }
+    else
+    {
+        glBufferData(target, size, NULL, GL_STREAM_DRAW);
+        s->memory = malloc(size);
+    }
+}
+
+void stream_free(struct stream_buffer *s)
+{
+    for (size_t i = 0; i < STREAM_SEGMENTS; i++)
+    {
+        if (s->fences[i])
+        {
+            glDeleteSync(s->fences[i]);
+        }
+    }
+
+    if (s->persistent)
+    {
+        glBindBuffer(s->target, s->vbo.id);
+        glUnmapBuffer(s->target);
+    }
+    else
+    {
+        free(s->memory);
+    }
+
+    glDeleteBuffers(1, &s->vbo.id);
+}
+
+static void stream_next_segment(struct stream_buffer *s)
+{
+    if (s->persistent)
+    {
+        s->fences[s->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    s->segment = (s->segment + 1) % STREAM_SEGMENTS;
+    s->offset = 0;
+
+    if (s->persistent && s->fences[s->segment])
+    {
+        GLenum status;
+        do
+        {
+            status = glClientWaitSync(s->fences[s->segment],
+                    GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        } while (status == GL_TIMEOUT_EXPIRED);
+
+        glDeleteSync(s->fences[s->segment]);
+        s->fences[s->segment] = NULL;
+    }
+    else if (!s->persistent && s->segment == 0)
+    {
+        // Draws may still read the old storage, the GL keeps it for them
+        glBindBuffer(s->target, s->vbo.id);
+        glBufferData(s->target, s->segment_size * STREAM_SEGMENTS, NULL,
+                GL_STREAM_DRAW);
+    }
+}
+
+void *stream_reserve(struct stream_buffer *s, size_t size, size_t align,
+        size_t *available)
+{
+    assert(size <= s->segment_size);
+
+    size_t base = s->segment * s->segment_size;
+    size_t start = (base + s->offset + align - 1) / align * align - base;
+    if (start + size > s->segment_size)
+    {
+        stream_next_segment(s);
+        base = s->segment * s->segment_size;
+        start = (base + align - 1) / align * align - base;
+    }
+
+    s->reserved = start;
+    *available = s->segment_size - start;
+    return s->memory + base + start;
+}
+
+size_t stream_commit(struct stream_buffer *s, size_t size)
+{
+    size_t offset = s->segment * s->segment_size + s->reserved;
+    if (!s->persistent && size)
+    {
+        glBindBuffer(s->target, s->vbo.id);
+        glBufferSubData(s->target, offset, size, s->memory + offset);
+    }
+
+    s->offset = s->reserved + size;
+    return offset;
+}
+
 void vao_init(struct vao *vao)
 {
     glGenVertexArrays(1, &vao->id);
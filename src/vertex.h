@@ -1,6 +1,12 @@
 #pragma once
 #include <GL/glew.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Segments of a stream buffer, the CPU only waits for the GPU when it comes
+// back around to a segment that is still being read
+#define STREAM_SEGMENTS 3
 
 enum vert_type
 {
@@ -41,10 +47,36 @@ struct vao
     size_t attrib_count;
 };
 
+// Ring of segments that the CPU writes into while earlier draws read the
+// others. With buffer storage the ring is persistently mapped and each
+// segment is guarded by a fence, otherwise writes go to a copy in memory
+// that is uploaded on commit, and the buffer is orphaned on every wrap.
+struct stream_buffer
+{
+    // Bound as either depending on the target
+    union
+    {
+        struct vbo vbo;
+        struct ebo ebo;
+    };
+    GLenum target;
+    size_t segment_size;
+    size_t segment;
+    // Committed bytes and the start of the last reserve in the segment
+    size_t offset;
+    size_t reserved;
+    bool persistent;
+    uint8_t *memory;
+    GLsync fences[STREAM_SEGMENTS];
+};
+
 void vbo_init(struct vbo *vbo, size_t size, const void *data,
         enum buffer_usage usage);
 void vbo_bind(struct vbo *vbo);
 void vbo_set_data(struct vbo *vbo, size_t size, const void *data);
+// Replaces the whole buffer, unlike vbo_set_data the size can change
+void vbo_set_storage(struct vbo *vbo, size_t size, const void *data,
+        enum buffer_usage usage);
 void vbo_free(struct vbo *vbo);
 
 void ebo_init(struct ebo *ebo, size_t count, const void *data,
@@ -53,6 +85,19 @@ void ebo_bind(struct ebo *ebo);
 void ebo_set_data(struct ebo *ebo, size_t count, const void *data);
 void ebo_free(struct ebo *ebo);
 
+void stream_init(struct stream_buffer *s, GLenum target,
+        size_t segment_size);
+void stream_free(struct stream_buffer *s);
+// Returns space for at least size bytes at an offset that is a multiple of
+// align, moving on to the next segment if this one is too full. Available
+// is set to how much can be written, everything written before must have
+// been committed and drawn.
+void *stream_reserve(struct stream_buffer *s, size_t size, size_t align,
+        size_t *available);
+// Hands the first size bytes of the last reserve to the GL and returns
+// their offset in the buffer
+size_t stream_commit(struct stream_buffer *s, size_t size);
+
 void vao_init(struct vao *vao);
 void vao_bind(struct vao *vao);
 void vao_set_ebo(struct vao *vao, struct ebo *ebo);
@@ -9,113 +9,879 @@
 #include "orb.h"
 #include "collide.h"
 #include "calc.h"
+#include "log.h"
+#include "job.h"
+#include "frame.h"
+
+// Broadphase used by new worlds, can be switched at runtime
+#ifndef WORLD_BROADPHASE
+#define WORLD_BROADPHASE BROADPHASE_GRID
+#endif
 
 #define WORLD_BOUNDS    100.0f
-#define ORB_COUNT       5000
 #define ORB_MIN_DIST    20.0f
 #define ORB_PADDING     10.0f
 
-struct actor_iter
+#define ARENA_BLOCK_SIZE        (1 << 20)
+#define GROUP_START_CAPACITY    64
+#define SLOT_START_CAPACITY     256
+#define NO_SLOT                 UINT32_MAX
+#define PAIR_START_CAPACITY     1024
+#define STATIC_UNBOUNDED_START_CAPACITY 8
+#define NARROWPHASE_JOB_GRAIN   256
+#define BOUNDS_JOB_GRAIN        512
+#define INSTANCE_JOB_GRAIN      1024
+// Interpolated transforms are gathered on the stack in batches this large
+#define INSTANCE_BATCH_SIZE     64
+
+static struct actor *slot_actor(struct world *w, uint32_t slot)
 {
-    struct world *world;
-    size_t next;
-    size_t found;
-    size_t target;
-    bool ignore_spawn;
-};
+    const struct actor_slot *sl = w->slots + slot;
+    return w->groups[sl->type].actors + sl->index;
+}
 
-static void actor_iter_init(struct actor_iter *iter, struct world *world,
-        bool ignore_spawn)
+static bool spawned_this_tick(const struct world *w, const struct actor *ac)
 {
-    iter->world = world;
-    iter->next = 0;
-    iter->found = 0;
-    iter->target = world->num_actors;
-    iter->ignore_spawn = ignore_spawn;
+    return actor_index(w, ac) >= w->groups[ac->type].num_ticking;
 }
 
-static struct actor *actor_iter_next(struct actor_iter *iter)
+static uint32_t alloc_slot(struct world *w)
 {
-    if (iter->found == iter->target)
+    if (w->free_slot != NO_SLOT)
     {
-        return NULL;
+        uint32_t slot = w->free_slot;
+        w->free_slot = w->slots[slot].index;
+        return slot;
     }
 
-    struct actor *ac;
-    do
+    if (w->slot_count == w->slot_capacity)
     {
-        ac = iter->world->actors + iter->next;
-        iter->next++;
-    } while (!ac->id ||
-            (iter->ignore_spawn && ac->spawn_tick == iter->world->tick));
+        size_t old_size = w->slot_capacity * sizeof(struct actor_slot);
+        w->slot_capacity =
+            w->slot_capacity ? w->slot_capacity * 2 : SLOT_START_CAPACITY;
+        w->slots = arena_realloc(&w->arena, w->slots, old_size,
+                w->slot_capacity * sizeof(struct actor_slot));
+    }
 
-    iter->found++;
-    return ac;
+    uint32_t slot = w->slot_count++;
+    w->slots[slot].gen = w->first_gen;
+    return slot;
 }
 
-static uint16_t find_free_actor(struct world *w)
+static void free_slot(struct world *w, uint32_t slot)
 {
-    uint16_t i = w->num_actors;
-    do
+    // Invalidates all ids referring to the slot
+    uint32_t gen = ++w->slots[slot].gen;
+    if (gen > w->last_gen)
     {
-        if (!w->actors[i].id)
-        {
-            return i + 1;
-        }
+        w->last_gen = gen;
+    }
 
-        i = (i + 1) % MAX_ACTORS;
-    } while (i != w->num_actors);
+    w->slots[slot].index = w->free_slot;
+    w->free_slot = slot;
+}
 
-    return 0;
+static size_t actor_type_data_size(enum actor_type type)
+{
+    switch (type)
+    {
+        case ACTOR_TYPE_PLAYER:
+            return sizeof(struct player_data);
+        case ACTOR_TYPE_ORB:
+            return sizeof(struct orb_data);
+        default:
+            return 0;
+    }
 }
 
-static void add_wall(struct world *w, struct mat4 rot)
+static void group_init(struct actor_group *g, size_t data_size)
+{
+    g->actors = NULL;
+    g->positions = NULL;
+    g->rotations = NULL;
+    g->prev_positions = NULL;
+    g->prev_rotations = NULL;
+    g->scales = NULL;
+    g->velocities = NULL;
+    g->cboxes = NULL;
+    g->matrices = NULL;
+    g->moved = NULL;
+    g->obbs = NULL;
+    g->bboxes = NULL;
+    g->data = NULL;
+    g->data_size = data_size;
+    g->count = 0;
+    g->capacity = 0;
+    g->num_ticking = 0;
+}
+
+static void group_reserve(struct actor_group *g, struct arena *arena,
+        size_t count)
+{
+    if (count <= g->capacity)
+    {
+        return;
+    }
+
+    size_t old = g->capacity;
+    size_t capacity = old ? old : GROUP_START_CAPACITY;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    g->capacity = capacity;
+
+    g->actors = arena_realloc(arena, g->actors,
+            old * sizeof(struct actor), capacity * sizeof(struct actor));
+    g->positions = arena_realloc(arena, g->positions,
+            old * sizeof(struct vec3), capacity * sizeof(struct vec3));
+    g->rotations = arena_realloc(arena, g->rotations,
+            old * sizeof(struct quat), capacity * sizeof(struct quat));
+    g->prev_positions = arena_realloc(arena, g->prev_positions,
+            old * sizeof(struct vec3), capacity * sizeof(struct vec3));
+    g->prev_rotations = arena_realloc(arena, g->prev_rotations,
+            old * sizeof(struct quat), capacity * sizeof(struct quat));
+    g->scales = arena_realloc(arena, g->scales,
+            old * sizeof(struct vec3), capacity * sizeof(struct vec3));
+    g->velocities = arena_realloc(arena, g->velocities,
+            old * sizeof(struct vec3), capacity * sizeof(struct vec3));
+    g->cboxes = arena_realloc(arena, g->cboxes,
+            old * sizeof(struct cbox), capacity * sizeof(struct cbox));
+    g->matrices = arena_realloc(arena, g->matrices,
+            old * sizeof(struct mat4), capacity * sizeof(struct mat4));
+    g->moved = arena_realloc(arena, g->moved,
+            old * sizeof(bool), capacity * sizeof(bool));
+    g->obbs = arena_realloc(arena, g->obbs,
+            old * sizeof(struct obb), capacity * sizeof(struct obb));
+    g->bboxes = arena_realloc(arena, g->bboxes,
+            old * sizeof(struct bbox), capacity * sizeof(struct bbox));
+    if (g->data_size)
+    {
+        g->data = arena_realloc(arena, g->data, old * g->data_size,
+                capacity * g->data_size);
+    }
+}
+
+static void group_move(struct world *w, struct actor_group *g, size_t dst,
+        size_t src)
+{
+    g->actors[dst] = g->actors[src];
+    g->positions[dst] = g->positions[src];
+    g->rotations[dst] = g->rotations[src];
+    g->prev_positions[dst] = g->prev_positions[src];
+    g->prev_rotations[dst] = g->prev_rotations[src];
+    g->scales[dst] = g->scales[src];
+    g->velocities[dst] = g->velocities[src];
+    g->cboxes[dst] = g->cboxes[src];
+    g->matrices[dst] = g->matrices[src];
+    g->moved[dst] = g->moved[src];
+    g->obbs[dst] = g->obbs[src];
+    g->bboxes[dst] = g->bboxes[src];
+    if (g->data)
+    {
+        memcpy((uint8_t *)g->data + dst * g->data_size,
+                (uint8_t *)g->data + src * g->data_size, g->data_size);
+    }
+
+    w->slots[g->actors[dst].id.slot].index = dst;
+}
+
+static struct transform group_transform(const struct actor_group *g,
+        size_t i)
+{
+    struct transform t;
+    t.pos = g->positions[i];
+    t.scale = g->scales[i];
+    t.rot = g->rotations[i];
+    return t;
+}
+
+// Transform between the last two ticks, alpha 0 being the previous tick
+static struct vec3 group_interp_position(const struct actor_group *g,
+        size_t i, float alpha)
+{
+    return vec3_add(g->prev_positions[i],
+            vec3_mul(vec3_sub(g->positions[i], g->prev_positions[i]), alpha));
+}
+
+static struct transform group_interp_transform(const struct actor_group *g,
+        size_t i, float alpha)
+{
+    struct transform t;
+    t.pos = group_interp_position(g, i, alpha);
+    t.scale = g->scales[i];
+    t.rot = quat_nlerp(g->prev_rotations[i], g->rotations[i], alpha);
+    return t;
+}
+
+static void group_store_previous(struct actor_group *g)
+{
+    memcpy(g->prev_positions, g->positions, g->count * sizeof(struct vec3));
+    memcpy(g->prev_rotations, g->rotations, g->count * sizeof(struct quat));
+}
+
+// Only for actors added to the broadphase before the next tick, the
+// others use the cached bboxes
+static struct bbox actor_bbox(const struct world *w, const struct actor *ac)
+{
+    const struct actor_group *g = w->groups + ac->type;
+    size_t i = actor_index(w, ac);
+
+    struct transform t = group_transform(g, i);
+    struct obb o;
+    obb_init(&o, &t, g->cboxes + i);
+    return shape_bbox(ac->shape, &o);
+}
+
+static void add_wall(struct world *w, struct quat rot)
 {
     const float wall_width = 1.0f;
     struct vec3 scale = vec3_create(WORLD_BOUNDS, WORLD_BOUNDS, wall_width);
 
     struct actor *wall = new_actor(w, VEC3_ZERO, ACTOR_TYPE_WALL);
-    wall->collide_mask =
-        actor_type_bit(ACTOR_TYPE_PLAYER) | actor_type_bit(ACTOR_TYPE_ORB);
-    wall->transform.rot = rot;
-    wall->transform.scale = scale;
+    wall->shape = COLLIDER_HALF_SPACE;
 
-    struct vec3 fwd = transform_forward(&wall->transform);
-    vec3_sub_eq(&wall->transform.pos, vec3_mul(fwd, WORLD_BOUNDS));
+    struct actor_group *g = w->groups + ACTOR_TYPE_WALL;
+    size_t i = actor_index(w, wall);
+    g->rotations[i] = rot;
+    g->scales[i] = scale;
+
+    struct vec3 fwd = quat_basis_z(rot);
+    vec3_sub_eq(g->positions + i, vec3_mul(fwd, WORLD_BOUNDS));
 }
 
 static void add_walls(struct world *w)
 {
-    add_wall(w, mat4_identity());
-    add_wall(w, mat4_roty(M_PI));
-    add_wall(w, mat4_rotx(M_PI / 2.0f));
-    add_wall(w, mat4_rotx(-M_PI / 2.0f));
-    add_wall(w, mat4_roty(M_PI / 2.0f));
-    add_wall(w, mat4_roty(-M_PI / 2.0f));
+    add_wall(w, quat_identity());
+    add_wall(w, quat_axis_angle(VEC3_UP, M_PI));
+    add_wall(w, quat_axis_angle(VEC3_RIGHT, M_PI / 2.0f));
+    add_wall(w, quat_axis_angle(VEC3_RIGHT, -M_PI / 2.0f));
+    add_wall(w, quat_axis_angle(VEC3_UP, M_PI / 2.0f));
+    add_wall(w, quat_axis_angle(VEC3_UP, -M_PI / 2.0f));
+}
+
+static void on_collide(struct world *w, struct actor *ac, struct actor *hit)
+{
+    switch (ac->type)
+    {
+        case ACTOR_TYPE_PLAYER:
+            player_on_collide(w, ac, hit);
+            break;
+        case ACTOR_TYPE_ORB:
+            orb_on_collide(w, ac, hit);
+            break;
+        default:
+            break;
+    }
+}
+
+static void add_pair(struct world *w, struct actor *a, struct actor *b)
+{
+    if (w->pair_count == w->pair_capacity)
+    {
+        w->pair_capacity *= 2;
+        w->pairs = realloc(w->pairs,
+                w->pair_capacity * sizeof(struct collision_pair));
+        w->pair_hits = realloc(w->pair_hits, w->pair_capacity);
+    }
+
+    struct collision_pair *pair = w->pairs + w->pair_count++;
+    pair->a = a;
+    pair->b = b;
+}
+
+// Every pair is found from one side only, see build_collide_matrix
+static void collide_candidate(struct world *w, struct actor *ac,
+        struct actor *other)
+{
+    if (!spawned_this_tick(w, ac) &&
+            !spawned_this_tick(w, other) &&
+            w->query_masks[ac->type] & actor_type_bit(other->type) &&
+            (other->type != ac->type || ac->id.slot < other->id.slot))
+    {
+        add_pair(w, ac, other);
+    }
+}
+
+static void static_collide(struct world *w, struct actor *ac, struct bbox box)
+{
+    if (!(w->query_masks[ac->type] & w->static_types))
+    {
+        return;
+    }
+
+    const uint32_t *candidates;
+    size_t count = bvh_query(&w->static_bvh, box, &candidates);
+
+    for (size_t j = 0; j < count; j++)
+    {
+        collide_candidate(w, ac, slot_actor(w, candidates[j]));
+    }
+
+    for (size_t j = 0; j < w->static_unbounded_count; j++)
+    {
+        struct actor *other = slot_actor(w, w->static_unbounded[j]);
+        const struct actor_group *g = w->groups + other->type;
+        if (bbox_overlapping(box, g->bboxes[actor_index(w, other)]))
+        {
+            collide_candidate(w, ac, other);
+        }
+    }
+}
+
+static bool queries_dynamic(const struct world *w, enum actor_type type)
+{
+    return w->query_masks[type] & ~w->static_types;
 }
 
 static void all_collide(struct world *w, struct actor *ac)
 {
-    struct actor_iter iter;
-    actor_iter_init(&iter, w, true);
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (!(actor_type_bit(type) & w->query_masks[ac->type]))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            collide_candidate(w, ac, g->actors + i);
+        }
+    }
+}
+
+static void grid_collide(struct world *w)
+{
+    grid_clear(&w->grid);
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (actor_type_static(type))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            grid_add(&w->grid, g->actors[i].id.slot, g->bboxes[i]);
+        }
+    }
+
+    grid_build(&w->grid);
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (!w->query_masks[type])
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            struct actor *ac = g->actors + i;
+            struct bbox box = g->bboxes[i];
+            static_collide(w, ac, box);
+
+            if (!queries_dynamic(w, type))
+            {
+                continue;
+            }
+
+            const uint32_t *candidates;
+            size_t count = grid_query(&w->grid, box, &candidates);
+
+            for (size_t j = 0; j < count; j++)
+            {
+                collide_candidate(w, ac, slot_actor(w, candidates[j]));
+            }
+        }
+    }
+}
+
+static void bvh_collide(struct world *w)
+{
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (actor_type_static(type))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            bvh_move(&w->bvh, g->actors[i].proxy, g->bboxes[i]);
+        }
+    }
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (!w->query_masks[type])
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            struct actor *ac = g->actors + i;
+            struct bbox box = g->bboxes[i];
+            static_collide(w, ac, box);
+
+            if (!queries_dynamic(w, type))
+            {
+                continue;
+            }
+
+            const uint32_t *candidates;
+            size_t count = bvh_query(&w->bvh, box, &candidates);
+
+            for (size_t j = 0; j < count; j++)
+            {
+                collide_candidate(w, ac, slot_actor(w, candidates[j]));
+            }
+        }
+    }
+}
+
+static void sap_collide(struct world *w)
+{
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (actor_type_static(type))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            sap_move(&w->sap, g->actors[i].proxy, g->bboxes[i]);
+        }
+    }
+
+    sap_update(&w->sap);
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (!(w->query_masks[type] & w->static_types))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->num_ticking; i++)
+        {
+            static_collide(w, g->actors + i, g->bboxes[i]);
+        }
+    }
+
+    // Only types that collide are paired, and the list is only changed
+    // by overlap start and end events. Overlapping boxes are not always
+    // touching, so every pair still goes through the narrowphase.
+    for (size_t i = 0; i < w->sap.pair_count; i++)
+    {
+        const struct sap_pair *pair = w->sap.pairs + i;
+        struct actor *a = slot_actor(w, pair->id_a);
+        struct actor *b = slot_actor(w, pair->id_b);
+
+        collide_candidate(w, a, b);
+        collide_candidate(w, b, a);
+    }
+}
+
+static void update_bounds(void *arg, size_t start, size_t end)
+{
+    struct actor_group *g = arg;
+
+    transform_matrices(g->matrices + start, g->positions + start,
+            g->rotations + start, g->scales + start, end - start);
+
+    for (size_t i = start; i < end; i++)
+    {
+        struct transform t = group_transform(g, i);
+        g->moved[i] =
+            memcmp(g->positions + i, g->prev_positions + i,
+                    sizeof(struct vec3)) ||
+            memcmp(g->rotations + i, g->prev_rotations + i,
+                    sizeof(struct quat));
+
+        obb_init(g->obbs + i, &t, g->cboxes + i);
+        g->bboxes[i] = shape_bbox(g->actors[i].shape, g->obbs + i);
+    }
+}
+
+static const struct obb *actor_obb(const struct world *w,
+        const struct actor *ac)
+{
+    return w->groups[ac->type].obbs + actor_index(w, ac);
+}
+
+static const struct bbox *actor_cached_bbox(const struct world *w,
+        const struct actor *ac)
+{
+    return w->groups[ac->type].bboxes + actor_index(w, ac);
+}
+
+// Only reads actor state, so it is safe to run on any thread
+static void test_pairs(void *arg, size_t start, size_t end)
+{
+    struct world *w = arg;
+
+    size_t i = start;
+    while (i < end)
+    {
+        const struct actor *a = w->pairs[i].a;
+        const struct bbox *bbox_a = actor_cached_bbox(w, a);
+
+        // Pairs from one broadphase query share their first actor, box
+        // pairs among them are tested together
+        const struct obb *others[OBB_BATCH_SIZE];
+        size_t indices[OBB_BATCH_SIZE];
+        size_t count = 0;
+        for (; i < end && count < OBB_BATCH_SIZE && w->pairs[i].a == a; i++)
+        {
+            const struct actor *b = w->pairs[i].b;
+            w->pair_hits[i] = false;
+            if (!bbox_overlapping(*bbox_a, *actor_cached_bbox(w, b)))
+            {
+                continue;
+            }
+
+            if (a->shape == COLLIDER_OBB && b->shape == COLLIDER_OBB)
+            {
+                others[count] = actor_obb(w, b);
+                indices[count++] = i;
+            }
+            else
+            {
+                w->pair_hits[i] = check_shapes(a->shape, actor_obb(w, a),
+                        b->shape, actor_obb(w, b));
+            }
+        }
+
+        if (count)
+        {
+            uint32_t hits = check_obb_batch(actor_obb(w, a), others, count);
+            for (size_t k = 0; k < count; k++)
+            {
+                w->pair_hits[indices[k]] = hits >> k & 1;
+            }
+        }
+    }
+}
+
+static int compare_contacts(const void *lhs, const void *rhs)
+{
+    const struct collision_pair *a = lhs;
+    const struct collision_pair *b = rhs;
+
+    if (a->a->id.slot != b->a->id.slot)
+    {
+        return a->a->id.slot < b->a->id.slot ? -1 : 1;
+    }
+    if (a->b->id.slot != b->b->id.slot)
+    {
+        return a->b->id.slot < b->b->id.slot ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static void verify_narrowphase(struct world *w)
+{
+    uint8_t *parallel_hits = frame_alloc(w->pair_count);
+    memcpy(parallel_hits, w->pair_hits, w->pair_count);
+
+    test_pairs(w, 0, w->pair_count);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < w->pair_count; i++)
+    {
+        if (parallel_hits[i] != w->pair_hits[i])
+        {
+            mismatches++;
+        }
+    }
+
+    if (mismatches)
+    {
+        log_err("Narrowphase mismatch in %zu of %zu pairs", mismatches,
+                w->pair_count);
+    }
+}
+
+static void narrowphase(struct world *w)
+{
+    job_parallel_for(w->pair_count, NARROWPHASE_JOB_GRAIN, test_pairs, w);
+
+    if (w->verify_narrowphase)
+    {
+        verify_narrowphase(w);
+    }
 
-    struct actor *other;
-    while ((other = actor_iter_next(&iter)))
+    size_t contact_count = 0;
+    for (size_t i = 0; i < w->pair_count; i++)
     {
-        if (other->id != ac->id &&
-                actor_type_bit(other->type) & ac->collide_mask)
+        contact_count += w->pair_hits[i];
+    }
+
+    struct collision_pair *contacts =
+        frame_alloc(contact_count * sizeof(struct collision_pair));
+    contact_count = 0;
+    for (size_t i = 0; i < w->pair_count; i++)
+    {
+        if (w->pair_hits[i])
         {
-            if (check_collide(ac, other))
+            contacts[contact_count++] = w->pairs[i];
+        }
+    }
+
+    // Broadphases find pairs in different orders, callbacks always run
+    // in order of the actor ids
+    qsort(contacts, contact_count, sizeof(struct collision_pair),
+            compare_contacts);
+
+    for (size_t i = 0; i < contact_count; i++)
+    {
+        struct collision_pair *c = contacts + i;
+        on_collide(w, c->a, c->b);
+        on_collide(w, c->b, c->a);
+    }
+}
+
+// Static actors are only added to their tree here, after whoever spawned
+// them has moved them into place
+static void build_static_tree(struct world *w)
+{
+    bvh_clear(&w->static_bvh);
+    w->static_unbounded_count = 0;
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (!actor_type_static(type))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->count; i++)
+        {
+            struct actor *ac = g->actors + i;
+            if (ac->shape != COLLIDER_HALF_SPACE)
             {
-                if (ac->on_collide)
+                ac->proxy = bvh_insert(&w->static_bvh, ac->id.slot,
+                        g->bboxes[i]);
+                continue;
+            }
+
+            if (w->static_unbounded_count == w->static_unbounded_capacity)
+            {
+                w->static_unbounded_capacity *= 2;
+                w->static_unbounded = realloc(w->static_unbounded,
+                        w->static_unbounded_capacity * sizeof(uint32_t));
+            }
+
+            ac->proxy = ACTOR_NO_PROXY;
+            w->static_unbounded[w->static_unbounded_count++] = ac->id.slot;
+        }
+    }
+
+    w->static_dirty = false;
+}
+
+static void world_collide(struct world *w)
+{
+    w->pair_count = 0;
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        struct actor_group *g = w->groups + type;
+        job_parallel_for(g->count, BOUNDS_JOB_GRAIN, update_bounds, g);
+    }
+
+    if (w->static_dirty)
+    {
+        build_static_tree(w);
+    }
+
+    switch (w->broadphase)
+    {
+        case BROADPHASE_BRUTE_FORCE:
+            for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+            {
+                if (!w->query_masks[type])
                 {
-                    ac->on_collide(ac, other);
+                    continue;
                 }
-                if (other->on_collide)
+
+                struct actor_group *g = w->groups + type;
+                for (size_t i = 0; i < g->num_ticking; i++)
                 {
-                    other->on_collide(other, ac);
+                    all_collide(w, g->actors + i);
                 }
             }
+            break;
+        case BROADPHASE_GRID:
+            grid_collide(w);
+            break;
+        case BROADPHASE_BVH:
+            bvh_collide(w);
+            break;
+        case BROADPHASE_SAP:
+            sap_collide(w);
+            break;
+        default:
+            break;
+    }
+
+    narrowphase(w);
+}
+
+static void add_proxy(struct world *w, struct actor *ac)
+{
+    if (actor_type_static(ac->type))
+    {
+        ac->proxy = ACTOR_NO_PROXY;
+        w->static_dirty = true;
+        w->static_version++;
+        return;
+    }
+
+    switch (w->broadphase)
+    {
+        case BROADPHASE_BVH:
+            ac->proxy = bvh_insert(&w->bvh, ac->id.slot, actor_bbox(w, ac));
+            break;
+        case BROADPHASE_SAP:
+            // Static types are found in the static tree instead
+            ac->proxy = sap_add(&w->sap, ac->id.slot,
+                    actor_type_bit(ac->type),
+                    w->collide_matrix[ac->type] & ~w->static_types,
+                    actor_bbox(w, ac));
+            break;
+        default:
+            ac->proxy = ACTOR_NO_PROXY;
+            break;
+    }
+}
+
+static void remove_proxy(struct world *w, struct actor *ac)
+{
+    if (actor_type_static(ac->type))
+    {
+        w->static_dirty = true;
+        w->static_version++;
+        return;
+    }
+
+    switch (w->broadphase)
+    {
+        case BROADPHASE_BVH:
+            bvh_remove(&w->bvh, ac->proxy);
+            break;
+        case BROADPHASE_SAP:
+            sap_remove(&w->sap, ac->proxy);
+            break;
+        default:
+            break;
+    }
+}
+
+static void set_broadphase(struct world *w, enum broadphase broadphase)
+{
+    // Incremental broadphases are only kept up to date while in use
+    bvh_clear(&w->bvh);
+    sap_clear(&w->sap);
+    w->broadphase = broadphase;
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (actor_type_static(type))
+        {
+            continue;
+        }
+
+        struct actor_group *g = w->groups + type;
+        for (size_t i = 0; i < g->count; i++)
+        {
+            add_proxy(w, g->actors + i);
+        }
+    }
+}
+
+// Types only collide if the masks in actor_types_init say so and at least
+// one of them moves. To test every pair once, dynamic types look for
+// static ones in the static tree and for dynamic types that come after
+// them, including their own.
+static void build_collide_matrix(struct world *w)
+{
+    w->static_types = 0;
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        w->collide_matrix[type] = 0;
+        if (actor_type_static(type))
+        {
+            w->static_types |= actor_type_bit(type);
+        }
+    }
+
+    for (enum actor_type a = 0; a < ACTOR_TYPE_END; a++)
+    {
+        for (enum actor_type b = 0; b < ACTOR_TYPE_END; b++)
+        {
+            if (actor_type_collide_mask(a) & actor_type_bit(b))
+            {
+                w->collide_matrix[a] |= actor_type_bit(b);
+                w->collide_matrix[b] |= actor_type_bit(a);
+            }
+        }
+    }
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        if (actor_type_static(type))
+        {
+            w->collide_matrix[type] &= ~w->static_types;
+            w->query_masks[type] = 0;
+            continue;
+        }
+
+        uint32_t later = ~(actor_type_bit(type) - 1);
+        w->query_masks[type] = w->collide_matrix[type] &
+            (w->static_types | later);
+    }
+}
+
+static void remove_dead_actors(struct world *w)
+{
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        struct actor_group *g = w->groups + type;
+
+        size_t i = 0;
+        while (i < g->count)
+        {
+            struct actor *ac = g->actors + i;
+            if (!(ac->flags & ACTOR_DEAD))
+            {
+                i++;
+                continue;
+            }
+
+            remove_proxy(w, ac);
+            free_slot(w, ac->id.slot);
+            w->num_actors--;
+
+            // Move the last actor into the hole to keep the group packed
+            g->count--;
+            if (i != g->count)
+            {
+                group_move(w, g, i, g->count);
+            }
         }
     }
 }
@@ -124,11 +890,49 @@ void world_init(struct world *w)
 {
     w->show_colliders = false;
     w->show_hud = true;
-    w->actors = calloc(MAX_ACTORS, sizeof(struct actor));
+    w->frustum_culling = true;
+    w->mesh_pass = true;
+    w->visible_capacity = GROUP_START_CAPACITY;
+    w->visible = malloc(w->visible_capacity * sizeof(uint32_t));
+    w->drawn_instances = 0;
+    w->culled_instances = 0;
+    arena_init(&w->arena, ARENA_BLOCK_SIZE);
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        group_init(w->groups + type, actor_type_data_size(type));
+    }
+
+    w->max_actors = MAX_ACTORS;
+    w->orb_count = ORB_COUNT;
+    w->slots = NULL;
+    w->slot_count = 0;
+    w->slot_capacity = 0;
+    w->free_slot = NO_SLOT;
+
+    // Generation 0 is never used, so that zeroed ids are invalid
+    w->first_gen = 1;
+    w->last_gen = 1;
+
+    w->pair_capacity = PAIR_START_CAPACITY;
+    w->pairs = malloc(w->pair_capacity * sizeof(struct collision_pair));
+    w->pair_hits = malloc(w->pair_capacity);
+    w->pair_count = 0;
+    w->verify_narrowphase = false;
 
-    // Spawn tick is 0 for all initial actors
-    w->tick = 0;
+    build_collide_matrix(w);
+    bvh_init(&w->static_bvh);
+    w->static_unbounded_capacity = STATIC_UNBOUNDED_START_CAPACITY;
+    w->static_unbounded = malloc(w->static_unbounded_capacity *
+            sizeof(uint32_t));
+    w->static_unbounded_count = 0;
+    w->static_dirty = false;
+    w->static_version = 0;
 
+    w->broadphase = WORLD_BROADPHASE;
+    grid_init(&w->grid);
+    bvh_init(&w->bvh);
+    sap_init(&w->sap);
     w->num_actors = 0;
     w->player = NULL;
 }
@@ -138,8 +942,9 @@ void world_begin(struct world *w)
     add_walls(w);
 
     w->player = spawn_player(w, VEC3_ZERO);
+    w->player_id = w->player->id;
 
-    for (size_t i = 0; i < ORB_COUNT; i++)
+    for (size_t i = 0; i < w->orb_count; i++)
     {
         struct vec3 pos = vec3_randrange(ORB_MIN_DIST,
                 WORLD_BOUNDS - ORB_PADDING);
@@ -149,111 +954,281 @@ void world_begin(struct world *w)
 
 void world_end(struct world *w)
 {
-    struct actor_iter iter;
-    actor_iter_init(&iter, w, false);
+    // All actor memory lives in the arena, so nothing is freed one by one
+    arena_reset(&w->arena);
 
-    struct actor *ac;
-    while ((ac = actor_iter_next(&iter)))
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
     {
-        actor_free(ac);
+        group_init(w->groups + type, w->groups[type].data_size);
     }
 
-    memset(w->actors, 0, sizeof(struct actor) * MAX_ACTORS);
+    w->slots = NULL;
+    w->slot_count = 0;
+    w->slot_capacity = 0;
+    w->free_slot = NO_SLOT;
+
+    // Ids from this round must not match slots of the next one
+    w->first_gen = w->last_gen + 1;
+    w->last_gen = w->first_gen;
+
+    bvh_clear(&w->static_bvh);
+    w->static_unbounded_count = 0;
+    w->static_dirty = false;
+    w->static_version++;
+    bvh_clear(&w->bvh);
+    sap_clear(&w->sap);
     w->num_actors = 0;
-    w->tick = 0;
     w->player = NULL;
 }
 
 void world_update(struct world *w, float dt)
 {
-    // Make sure that tick is not 0
-    w->tick = min(1, w->tick + 1);
+    remove_dead_actors(w);
+    w->player = get_actor(w, w->player_id);
+
+    for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
+    {
+        struct actor_group *g = w->groups + type;
+        g->num_ticking = g->count;
+        group_store_previous(g);
+    }
 
-    struct actor_iter iter;
-    actor_iter_init(&iter, w, true);
+    player_update(w, dt);
+    orb_update(w, dt);
 
-    struct actor *ac;
-    while((ac = actor_iter_next(&iter)))
+    // Collisions are resolved after all actors have moved
+    world_collide(w);
+
+    if (w->player && w->player->flags & ACTOR_DEAD)
+    {
+        w->player = NULL;
+    }
+}
+
+void world_camera_view(struct world *w, float alpha)
+{
+    if (w->player)
     {
-        if (ac->flags & ACTOR_DEAD)
+        struct camera *cam = get_camera();
+        struct transform t = actor_interp_transform(w, w->player, alpha);
+        player_camera_view(w, w->player, &t, cam);
+    }
+}
+
+struct instance_job
+{
+    const struct actor_group *group;
+    const uint32_t *indices;
+    struct mat4 *models;
+    float alpha;
+};
+
+// Collects the indices of the actors in the group that are drawn, those
+// whose mesh bounds touch the frustum unless culling is off
+static size_t cull_instances(struct world *w, const struct actor_group *g,
+        const struct frustum *f, float mesh_radius, float alpha)
+{
+    if (g->count > w->visible_capacity)
+    {
+        while (w->visible_capacity < g->count)
         {
-            actor_free(ac);
-            ac->id = 0;
-            w->num_actors--;
+            w->visible_capacity *= 2;
         }
-        else
+        w->visible = realloc(w->visible,
+                w->visible_capacity * sizeof(uint32_t));
+    }
+
+    size_t count = 0;
+    if (!w->frustum_culling)
+    {
+        for (size_t i = 0; i < g->count; i++)
         {
-            // Ensure that the actor won't be skipped
-            ac->spawn_tick = 0;
+            w->visible[count++] = i;
+        }
+        return count;
+    }
 
-            switch (ac->type)
-            {
-                case ACTOR_TYPE_PLAYER:
-                    player_update(ac, dt);
-                    break;
-                case ACTOR_TYPE_ORB:
-                    orb_update(ac, dt);
-                    break;
-                default:
-                    break;
-            }
+    for (size_t i = 0; i < g->count; i += FRUSTUM_BATCH_SIZE)
+    {
+        size_t n = g->count - i < FRUSTUM_BATCH_SIZE ?
+            g->count - i : FRUSTUM_BATCH_SIZE;
+
+        // Rotation does not matter for a sphere around the mesh origin
+        struct vec3 centers[FRUSTUM_BATCH_SIZE];
+        float radii[FRUSTUM_BATCH_SIZE];
+        for (size_t k = 0; k < n; k++)
+        {
+            struct vec3 s = g->scales[i + k];
+            centers[k] = g->moved[i + k] ?
+                group_interp_position(g, i + k, alpha) : g->positions[i + k];
+            radii[k] = mesh_radius *
+                fmaxf(fmaxf(fabsf(s.x), fabsf(s.y)), fabsf(s.z));
+        }
 
-            if (ac->collide_mask)
+        uint32_t hits = check_frustum_spheres(f, centers, radii, n);
+        for (size_t k = 0; k < n; k++)
+        {
+            if (hits >> k & 1)
             {
-                all_collide(w, ac);
+                w->visible[count++] = i + k;
             }
         }
     }
 
-    if (w->player)
+    return count;
+}
+
+// Transforms a batch of interpolated actors into their instance slots,
+// straight into place when the slots are contiguous
+static void write_instance_batch(struct mat4 *models, const size_t *slots,
+        const struct vec3 *positions, const struct quat *rotations,
+        const struct vec3 *scales, size_t count)
+{
+    if (!count)
     {
-        struct camera *cam = get_camera();
-        player_camera_view(w->player, cam, dt);
+        return;
+    }
+
+    if (slots[count - 1] - slots[0] == count - 1)
+    {
+        transform_matrices(models + slots[0], positions, rotations, scales,
+                count);
+        return;
+    }
+
+    struct mat4 batch[INSTANCE_BATCH_SIZE];
+    transform_matrices(batch, positions, rotations, scales, count);
+    for (size_t k = 0; k < count; k++)
+    {
+        models[slots[k]] = batch[k];
+    }
+}
 
-        if (w->player->flags & ACTOR_DEAD)
+// Writes the models of a range of the drawn actors straight into the
+// instance buffer. Actors that did not move in the last tick copy their
+// cached matrix, the others are interpolated in batches.
+static void build_instances(void *arg, size_t start, size_t end)
+{
+    const struct instance_job *job = arg;
+    const struct actor_group *g = job->group;
+    size_t slots[INSTANCE_BATCH_SIZE];
+    struct vec3 positions[INSTANCE_BATCH_SIZE];
+    struct quat rotations[INSTANCE_BATCH_SIZE];
+    struct vec3 scales[INSTANCE_BATCH_SIZE];
+    size_t count = 0;
+
+    for (size_t i = start; i < end; i++)
+    {
+        size_t index = job->indices[i];
+        if (!g->moved[index])
+        {
+            job->models[i] = g->matrices[index];
+            continue;
+        }
+
+        struct transform t = group_interp_transform(g, index, job->alpha);
+        slots[count] = i;
+        positions[count] = t.pos;
+        rotations[count] = t.rot;
+        scales[count] = g->scales[index];
+
+        if (++count == INSTANCE_BATCH_SIZE)
         {
-            w->player = NULL;
+            write_instance_batch(job->models, slots, positions, rotations,
+                    scales, count);
+            count = 0;
         }
     }
+
+    write_instance_batch(job->models, slots, positions, rotations, scales,
+            count);
 }
 
-void world_render(struct world *w)
+void world_render(struct world *w, float alpha)
 {
+    struct camera *cam = get_camera();
+    struct mat4 view = camera_view(cam);
+    struct mat4 proj = camera_projection(cam);
+    struct mat4 view_proj = mat4_mul(proj, view);
+    struct frustum frustum;
+    frustum_init(&frustum, &view_proj);
+
+    w->drawn_instances = 0;
+    w->culled_instances = 0;
+
+    if (w->mesh_pass)
+    {
+        render_mesh_pass_begin();
+    }
+
     for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
     {
         struct render_spec rspec = actor_type_render_spec(type);
-        render_mesh_instancing_begin(get_mesh(rspec.mesh_handle));
-
-        struct actor_iter iter;
-        actor_iter_init(&iter, w, false);
+        const struct mesh *mesh = get_mesh(rspec.mesh_handle);
+        struct actor_group *g = w->groups + type;
 
-        struct actor *ac;
-        while ((ac = actor_iter_next(&iter)))
+        // Static instances are only uploaded again when they change, as
+        // long as they fit in one cached batch
+        if (actor_type_static(type) && g->count <= MAX_MESH_INSTANCES)
         {
-            if (ac->type == type)
+            if (!render_mesh_instancing_begin_cached(mesh, type,
+                        w->static_version))
             {
-                render_push_mesh_transform(&ac->transform);
+                transform_matrices(render_push_mesh_instances(g->count),
+                        g->positions, g->rotations, g->scales, g->count);
             }
+
+            // Kept whole so the cached batch stays valid
+            w->drawn_instances += g->count;
+            render_mesh_instancing_end();
+            continue;
+        }
+
+        render_mesh_instancing_begin(mesh);
+
+        size_t count = cull_instances(w, g, &frustum, mesh->radius, alpha);
+        w->drawn_instances += count;
+        w->culled_instances += g->count - count;
+
+        // Reserved in chunks the instance stream can hold at once
+        for (size_t first = 0; first < count; first += MAX_MESH_INSTANCES)
+        {
+            size_t chunk = count - first < MAX_MESH_INSTANCES ?
+                count - first : MAX_MESH_INSTANCES;
+
+            struct instance_job job;
+            job.group = g;
+            job.indices = w->visible + first;
+            job.models = render_push_mesh_instances(chunk);
+            job.alpha = alpha;
+            job_parallel_for(chunk, INSTANCE_JOB_GRAIN, build_instances,
+                    &job);
         }
 
         render_mesh_instancing_end();
     }
 
+    if (w->mesh_pass)
+    {
+        render_mesh_pass_end();
+    }
+
     if (w->show_colliders)
     {
         render_untextured_begin();
 
-        struct actor_iter iter;
-        actor_iter_init(&iter, w, false);
-
-        struct actor *ac;
-        while ((ac = actor_iter_next(&iter)))
+        for (enum actor_type type = 0; type < ACTOR_TYPE_END; type++)
         {
-            struct vec3 scale = ac->transform.scale;
-            struct vec3 bounds = ac->cbox.bounds;
-            float cmax = fmax(fmax(scale.x * bounds.x, scale.y * bounds.y),
-                    scale.z * bounds.z);
-            render_collider_outline(ac, cmax * 0.1f, COLOR_RED);
+            struct actor_group *g = w->groups + type;
+            for (size_t i = 0; i < g->count; i++)
+            {
+                struct transform t = group_transform(g, i);
+                struct vec3 bounds = g->cboxes[i].bounds;
+                float cmax = fmax(fmax(t.scale.x * bounds.x,
+                        t.scale.y * bounds.y), t.scale.z * bounds.z);
+                render_collider_outline(g->actors[i].shape, &t,
+                        g->cboxes + i, cmax * 0.1f, COLOR_RED);
+            }
         }
 
         render_untextured_end();
@@ -261,11 +1236,10 @@ void world_render(struct world *w)
 
     if (w->player && w->show_hud)
     {
-        struct camera *cam = get_camera();
-
         render_ui_begin();
-        player_render_hud(w->player, cam);
-        player_render_state_info(w->player);
+        struct transform t = actor_interp_transform(w, w->player, alpha);
+        player_render_hud(w, w->player, &t, cam);
+        player_render_state_info(w, w->player);
         render_ui_end();
     }
 }
@@ -273,7 +1247,15 @@ void world_render(struct world *w)
 void world_free(struct world *w)
 {
     world_end(w);
-    free(w->actors);
+    bvh_free(&w->static_bvh);
+    free(w->static_unbounded);
+    grid_free(&w->grid);
+    bvh_free(&w->bvh);
+    sap_free(&w->sap);
+    arena_free(&w->arena);
+    free(w->pairs);
+    free(w->pair_hits);
+    free(w->visible);
 }
 
 bool world_should_end(const struct world *w)
@@ -284,25 +1266,69 @@ bool world_should_end(const struct world *w)
 struct actor *new_actor(struct world *w, struct vec3 pos,
         enum actor_type type)
 {
-    assert(w->num_actors < MAX_ACTORS);
+    assert(w->num_actors < w->max_actors);
 
-    uint16_t new_id = find_free_actor(w);
-    struct actor *new_ac = get_actor(w, new_id);
-
-    actor_init(new_ac, w, new_id, type, w->tick, pos);
+    struct actor_group *g = w->groups + type;
+    group_reserve(g, &w->arena, g->count + 1);
+    size_t i = g->count++;
     w->num_actors++;
 
+    struct actor_id new_id;
+    new_id.slot = alloc_slot(w);
+    new_id.gen = w->slots[new_id.slot].gen;
+
+    struct actor_slot *slot = w->slots + new_id.slot;
+    slot->index = i;
+    slot->type = type;
+
+    struct actor *new_ac = g->actors + i;
+    actor_init(new_ac, new_id, type);
+    g->positions[i] = pos;
+    g->rotations[i] = quat_identity();
+    g->prev_positions[i] = pos;
+    g->prev_rotations[i] = quat_identity();
+    g->scales[i] = VEC3_ONE;
+    g->velocities[i] = VEC3_ZERO;
+    g->moved[i] = true;
+    cbox_init(g->cboxes + i);
+
+    add_proxy(w, new_ac);
+
     return new_ac;
 }
 
-struct actor *get_actor(struct world *w, uint16_t id)
+struct actor *get_actor(struct world *w, struct actor_id id)
 {
-    if (!id)
+    if (id.slot >= w->slot_count || w->slots[id.slot].gen != id.gen)
     {
         return NULL;
     }
 
-    return w->actors + id - 1;
+    return slot_actor(w, id.slot);
+}
+
+size_t actor_index(const struct world *w, const struct actor *ac)
+{
+    return ac - w->groups[ac->type].actors;
+}
+
+struct transform actor_transform(const struct world *w,
+        const struct actor *ac)
+{
+    return group_transform(w->groups + ac->type, actor_index(w, ac));
+}
+
+struct transform actor_interp_transform(const struct world *w,
+        const struct actor *ac, float alpha)
+{
+    return group_interp_transform(w->groups + ac->type, actor_index(w, ac),
+            alpha);
+}
+
+void *actor_data(struct world *w, const struct actor *ac)
+{
+    const struct actor_group *g = w->groups + ac->type;
+    return (uint8_t *)g->data + actor_index(w, ac) * g->data_size;
 }
 
 void toggle_collider_rendering(struct world *w)
@@ -314,3 +1340,29 @@ void toggle_hud_rendering(struct world *w)
 {
     w->show_hud = !w->show_hud;
 }
+
+void toggle_frustum_culling(struct world *w)
+{
+    w->frustum_culling = !w->frustum_culling;
+    log_info("Frustum culling: %s", w->frustum_culling ? "on" : "off");
+}
+
+void toggle_mesh_pass(struct world *w)
+{
+    w->mesh_pass = !w->mesh_pass;
+    log_info("Mesh pass: %s", w->mesh_pass ? "on" : "off");
+}
+
+void toggle_broadphase(struct world *w)
+{
+    static const char *names[BROADPHASE_END] =
+    {
+        "brute force",
+        "grid",
+        "bvh",
+        "sweep and prune",
+    };
+
+    set_broadphase(w, (w->broadphase + 1) % BROADPHASE_END);
+    log_info("Broadphase: %s", names[w->broadphase]);
+}
@@ -1,16 +1,139 @@
 #pragma once
 #include "actor.h"
+#include "arena.h"
+#include "grid.h"
+#include "bvh.h"
+#include "sap.h"
 
+// Defaults for the per-world limit on live actors and orbs spawned
 #define MAX_ACTORS 20000
+#define ORB_COUNT 5000
+
+enum broadphase
+{
+    BROADPHASE_BRUTE_FORCE,
+    BROADPHASE_GRID,
+    BROADPHASE_BVH,
+    BROADPHASE_SAP,
+    BROADPHASE_END,
+};
+
+// Actors of one type, with their components stored in parallel arrays
+// indexed like the actors. The arrays grow on demand, so spawning may move
+// the other actors of the same type.
+struct actor_group
+{
+    struct actor *actors;
+    struct vec3 *positions;
+    struct quat *rotations;
+    struct vec3 *scales;
+    struct vec3 *velocities;
+    struct cbox *cboxes;
+
+    // State at the start of the last tick, for render interpolation
+    struct vec3 *prev_positions;
+    struct quat *prev_rotations;
+
+    // World matrices, collision boxes and their bounds, rebuilt every tick
+    // after movement. Actors that did not move in the last tick are not
+    // interpolated, build_instances copies their cached matrix.
+    struct mat4 *matrices;
+    bool *moved;
+    struct obb *obbs;
+    struct bbox *bboxes;
+
+    // Type specific data, e.g. struct orb_data for orbs
+    void *data;
+    size_t data_size;
+
+    uint32_t count;
+    uint32_t capacity;
+
+    // Actors spawned during a tick are placed after this count and are
+    // skipped until the next tick
+    uint32_t num_ticking;
+};
+
+struct actor_slot
+{
+    // Index of the actor in its group, or the next free slot
+    uint32_t index;
+    uint32_t gen;
+    enum actor_type type;
+};
+
+struct collision_pair
+{
+    struct actor *a;
+    struct actor *b;
+};
 
 struct world
 {
     struct actor *player;
-    struct actor *actors;
-    uint16_t num_actors;
-    uint8_t tick;
+    struct actor_id player_id;
+
+    struct actor_group groups[ACTOR_TYPE_END];
+    uint32_t num_actors;
+    uint32_t max_actors;
+    uint32_t orb_count;
+
+    struct actor_slot *slots;
+    uint32_t slot_count;
+    uint32_t slot_capacity;
+    uint32_t free_slot;
+
+    // Generation of new slots and the highest generation handed out
+    uint32_t first_gen;
+    uint32_t last_gen;
+
+    // Backs the actor groups and slots, reset by world_end
+    struct arena arena;
+
+    // Candidate pairs found by the broadphase and whether they touch. Kept
+    // between ticks, so they only grow while the pair count does.
+    struct collision_pair *pairs;
+    uint8_t *pair_hits;
+    size_t pair_count;
+    size_t pair_capacity;
+
+    // Also runs the narrowphase serially and reports any differences
+    bool verify_narrowphase;
+
+    // Types each type collides with and the subset it looks for in the
+    // broadphase, so that every pair is only found once
+    uint32_t collide_matrix[ACTOR_TYPE_END];
+    uint32_t query_masks[ACTOR_TYPE_END];
+    uint32_t static_types;
+
+    // Static actors are kept out of the broadphase in their own tree,
+    // rebuilt only when they are spawned or removed. Unbounded ones are
+    // listed by slot and tested against every query instead.
+    struct bvh static_bvh;
+    uint32_t *static_unbounded;
+    size_t static_unbounded_count;
+    size_t static_unbounded_capacity;
+    bool static_dirty;
+    // Changes whenever a static actor is spawned or removed
+    uint64_t static_version;
+
+    enum broadphase broadphase;
+    struct grid grid;
+    struct bvh bvh;
+    struct sap sap;
     bool show_colliders;
     bool show_hud;
+
+    // Skips instances outside the camera frustum when rendering
+    bool frustum_culling;
+    // Draws all mesh types in one render pass instead of one by one
+    bool mesh_pass;
+    // Indices of the instances of a group that are drawn
+    uint32_t *visible;
+    size_t visible_capacity;
+    // Counted over the last world_render
+    size_t drawn_instances;
+    size_t culled_instances;
 };
 
 void world_init(struct world *w);
@@ -19,13 +142,26 @@ void world_free(struct world *w);
 void world_begin(struct world *w);
 void world_end(struct world *w);
 void world_update(struct world *w, float dt);
-void world_render(struct world *w);
+
+// Alpha is how far rendering is between the previous and the last tick
+void world_camera_view(struct world *w, float alpha);
+void world_render(struct world *w, float alpha);
 
 bool world_should_end(const struct world *w);
 
 struct actor *new_actor(struct world *w, struct vec3 pos,
         enum actor_type type);
-struct actor *get_actor(struct world *w, uint16_t id);
+struct actor *get_actor(struct world *w, struct actor_id id);
+
+size_t actor_index(const struct world *w, const struct actor *ac);
+struct transform actor_transform(const struct world *w,
+        const struct actor *ac);
+struct transform actor_interp_transform(const struct world *w,
+        const struct actor *ac, float alpha);
+void *actor_data(struct world *w, const struct actor *ac);
 
 void toggle_collider_rendering(struct world *w);
 void toggle_hud_rendering(struct world *w);
+void toggle_broadphase(struct world *w);
+void toggle_frustum_culling(struct world *w);
+void toggle_mesh_pass(struct world *w);